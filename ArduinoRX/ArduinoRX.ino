@@ -1,6 +1,15 @@
 #include "radio.h"
 #include "hal.h"
 #include "SPI.h"
+#include "../Common/packet.h"
+#include "../Common/link.h"
+#include "../Common/link_profile.h"
+#include "../Common/serial_frame.h"
+
+// Define SERIAL_TEXT_DUMP to print packets as readable text instead of sending binary
+// frames (see serial_frame.h). Text is handy on a serial monitor but is several times
+// bigger, and Serial.print blocks once its buffer is full while the radio's RX FIFO fills.
+//#define SERIAL_TEXT_DUMP
 
 #define BIT0 (1<<0)
 #define BIT1 (1<<1)
@@ -11,65 +20,53 @@
 #define BIT6 (1<<6)
 #define BIT7 (1<<7)
 
-void radioSetup()
+const uint8_t g_channels[LINK_CHANNEL_COUNT] = LINK_CHANNELS;
+const LinkProfile g_linkProfiles[LINK_PROFILE_COUNT] = LINK_PROFILES;
+
+// Index into g_channels of the channel we're listening on
+volatile uint8_t g_channelIndex = 0;
+
+// From reading a STATE_EXT_HOP_CONFIRM to its ACK being out, for the link profile: the
+// round trip of the confirm and its ACK, so the confirm's own air time is margin for
+// the drain that read it
+uint16_t g_hopSwitchMicros = 0;
+
+// The link profile sends each state as NOACK copies (LinkProfile.copies)
+bool g_burstLink = false;
+
+// Which link profile, from the jumpers. Must match the controllers' DIP switches.
+const LinkProfile* readLinkProfile()
+{
+  uint8_t profile = (digitalRead(PIN_PROFILE0) == LOW ? 1 : 0) |
+                    (digitalRead(PIN_PROFILE1) == LOW ? 2 : 0);
+  return &g_linkProfiles[profile < LINK_PROFILE_COUNT ? profile : LINK_PROFILE_STANDARD];
+}
+
+void radioSetup(const LinkProfile* profile)
 {
   // Wait for radio to enter power-down state
   delay(125);
   
-  // CONFIG register
-  // 7 Reserved       = 0
-  // 6 MASK_RX_DR     = 0: enable RX interrupt
-  // 5 MASK_TX_DR     = 0: enable TX complete interrupt
-  // 4 MASK_MAX_RT    = 0: enable TX max retries interrupt
-  // 3 EN_CRC         = 1: enable CRC
-  // 2 CRC0           = 1: 2-byte CRC
-  // 1 PWR_UP         = 1: power up
-  // 1 PRIM_RX        = 1: primary RX
-  radioWriteRegisterByte(RADIO_REG_CONFIG, BIT3 | BIT2 | BIT1 | BIT0);
-  
-  // Enable auto ack on pipes 0,1
-  radioWriteRegisterByte(RADIO_REG_EN_AA, BIT1 | BIT0);
-  
-  // Enable receive on pipes 0,1
-  radioWriteRegisterByte(RADIO_REG_EN_RXADDR, BIT1 | BIT0);
-  
-  // Set address width to 3 bytes
-  radioWriteRegisterByte(RADIO_REG_SETUP_AW, 1);
-  
-  // Auto retransmit delay - 250 usec RX mode (MSByte=0), 0 auto retransmit (LSByte=0)
-  radioWriteRegisterByte(RADIO_REG_SETUP_RETR, 0x00);
-  
-  // Set RF channel to 2403 MHz
-  radioWriteRegisterByte(RADIO_REG_RF_CH, 3);
-  
-  // RF_SETUP
-  // 7   CONT_WAVE    = 0: Continuous carrier transmit off (we are not in test mode)
-  // 6   Reserved     = 0:
-  // 5   RF_DR_LOW    = 0: With RF_DR_HIGH, set 1 Mbps rate
-  // 4   PLL_LOCK     = 0: Do not force PLL lock (we are not in test mode)
-  // 3   RF_DR_HIGH   = 0: With RF_DR_LOW, set 1 Mbps rate
-  // 2:1 RF_PWR       = 11: 0 dBm
-  // 0   Obsolete     = 0: (don't care)
-  radioWriteRegisterByte(RADIO_REG_RF_SETUP, BIT2 | BIT1);
-  
-  uint8_t destAddr[] = {0xC2, 0xC2, 0xC2};
-  uint8_t srcAddr[] = {0xE7, 0xE7, 0xE7};
-  
-  // Set TX/RX addresses. We must receive on the address we send to for auto-ACK to work.
-  radioWriteRegister(RADIO_REG_RX_ADDR_P0, srcAddr, sizeof(srcAddr));
-  radioWriteRegister(RADIO_REG_RX_ADDR_P1, destAddr, sizeof(destAddr));
-  radioWriteRegister(RADIO_REG_TX_ADDR, destAddr, sizeof(destAddr));
-  
-  //radioWriteRegisterByte(RADIO_REG_RX_PW_P0, 32);
-  
-  // Enable dynamic payload length on pipes 0,1
-  radioWriteRegisterByte(RADIO_REG_DYNPD, BIT1 | BIT0);
-  
-  // FEATURE
-  // 2 EN_DPL         = 1: Enable dynamic payload length
-  // 1 EN_ACK_PAY     = 0: Disable ACK payload
-  // 0 EN_DYN_ACK     = 0: Don't need to send TX w/o ACK
-  radioWriteRegisterByte(RADIO_REG_FEATURE, BIT2);
+  // Everything that has to match the controllers (see radio_init.h): all six pipes,
+  // primary RX, on the first of LINK_CHANNELS until a controller asks to hop
+  const RadioRegisterInit init[LINK_RADIO_INIT_COUNT] =
+    LINK_RADIO_INIT(profile, g_channels[g_channelIndex], 0x3F, LINK_RADIO_PRX);
+  radioWriteRegisters(init, LINK_RADIO_INIT_COUNT);
+  
+  // RX addresses: pipe n listens for controller unit n (see link.h).
+  // Pipes 2-5 only take the LSByte; the rest comes from pipe 1.
+  uint8_t unit0Addr[LINK_ADDRESS_MAX_WIDTH];
+  uint8_t unit1Addr[LINK_ADDRESS_MAX_WIDTH];
+  linkUnitAddress(0, unit0Addr);
+  linkUnitAddress(1, unit1Addr);
+  
+  radioWriteRegister(RADIO_REG_RX_ADDR_P0, unit0Addr, profile->addressWidth);
+  radioWriteRegister(RADIO_REG_RX_ADDR_P1, unit1Addr, profile->addressWidth);
+  for (uint8_t unit = 2; unit < LINK_UNIT_COUNT; ++unit)
+  {
+    radioWriteRegisterByte(RADIO_REG_RX_ADDR_P0 + unit, LINK_UNIT_ADDRESS_LSB(unit));
+  }
+  radioWriteRegister(RADIO_REG_TX_ADDR, unit1Addr, profile->addressWidth);
   
   // Clear all queues and clear interrupt bits
   radioFlushTX();
@@ -98,82 +95,701 @@ void setup()
   pinMode(PIN_SCK, OUTPUT);
   pinMode(PIN_IRQ, INPUT); 
   pinMode(PIN_MISO, INPUT);
+  pinMode(PIN_PROFILE0, INPUT_PULLUP);
+  pinMode(PIN_PROFILE1, INPUT_PULLUP);
   
   SPI.setDataMode(SPI_MODE0);
   SPI.setBitOrder(MSBFIRST);
   SPI.setClockDivider(SPI_CLOCK_DIV4);
+  SPI.begin();
   
   Serial.begin(115200);
+#ifndef SERIAL_TEXT_DUMP
+  // Start on a frame boundary, so the PC doesn't discard the first frame
+  Serial.write((uint8_t)SERIAL_FRAME_DELIMITER);
+#endif
+  
+  const LinkProfile* profile = readLinkProfile();
+  radioSetup(profile);
+  g_hopSwitchMicros = linkProfileRoundTripMicros(profile, sizeof(StatePacket) + sizeof(StateExtension),
+                                                 sizeof(AckPacket));
+  g_burstLink = profile->copies != 0;
+  
+  // Radio IRQ on pin change interrupt: PIN_IRQ is PB1, PCINT1
+  PCMSK0 |= _BV(PCINT1);
+  PCICR |= _BV(PCIE0);
+}
+
+// Packets drained from the radio by the IRQ handler, waiting for loop() to report them.
+// Single producer (the ISR) and single consumer (loop()): the ISR only writes g_rxHead and
+// loop() only writes g_rxTail, and both are single bytes, so neither needs a lock.
+#define RX_RING_SIZE 8            // power of 2
+#define RX_RING_BAD_SIZE 0xFF     // pipe value for a payload width that wasn't valid
+
+struct RxEntry
+{
+  uint8_t pipe;
+  uint8_t size;                   // payload bytes, or the bad width for RX_RING_BAD_SIZE
+  uint16_t time;                  // millis() when drained, low 16 bits
+  uint8_t payload[32];
+};
+
+RxEntry g_rxRing[RX_RING_SIZE];
+volatile uint8_t g_rxHead = 0;
+volatile uint8_t g_rxTail = 0;
+
+// Overflow counters, written by the ISR. Read them with interrupts off.
+volatile uint16_t g_rxRingOverflows = 0;  // packets drained but dropped: ring was full
+volatile uint16_t g_rxFifoFull = 0;       // drains that found all three RX FIFO slots used
+uint16_t g_reportedRingOverflows = 0;
+uint16_t g_reportedFifoFull = 0;
+
+uint8_t g_frameSeq = 0;
+
+// Send one frame: a header of the given type, then the body
+void sendFrame(uint8_t type, uint16_t time, const uint8_t* body, uint8_t bodySize)
+{
+  uint8_t frame[SERIAL_FRAME_MAX_SIZE];
+  uint8_t encoded[SERIAL_FRAME_MAX_ENCODED_SIZE(SERIAL_FRAME_MAX_SIZE)];
+  
+  SerialFrameHeader header;
+  header.type = type;
+  header.seq = g_frameSeq++;
+  header.time = time;
+  
+  memcpy(frame, &header, sizeof(header));
+  memcpy(frame + sizeof(header), body, bodySize);
+  
+  size_t encodedSize = serialFrameEncode(frame, sizeof(header) + bodySize, encoded);
+  Serial.write(encoded, encodedSize);
+}
+
+// Channel survey and hopping (see link.h).
+// Between RPD samples: the radio needs Tdelay_AGC (40 us) in RX before RPD is valid
+#define SURVEY_SAMPLES 16
+#define SURVEY_SAMPLE_MICROS 40
+
+// Standby to RX (Tstby2a) on each channel before sampling
+#define SURVEY_SETTLE_MICROS 130
+
+// How long a hop offer stands without a controller confirming it. Also the least time
+// between surveys: loss that no other channel would cure (e.g. range) keeps controllers
+// asking, and each survey leaves us deaf for a while.
+#define HOP_OFFER_MILLIS 3000
+
+#define NO_HOP SERIAL_SURVEY_NO_HOP
+
+volatile bool g_surveyRequested = false;   // a controller sent STATE_EXT_HOP_REQUEST
+volatile uint8_t g_hopIndex = NO_HOP;      // offered with ACK_COMMAND_HOP
+unsigned long g_hopOfferedMillis = 0;
+unsigned long g_surveyMillis = 0;
+bool g_surveyed = false;
+volatile uint8_t g_hops = 0;
+uint8_t g_reportedHops = 0;
+
+// A confirmed hop waits for its ACK to go out. The ISR notes it and loop() moves once
+// g_hopSwitchMicros have passed.
+volatile uint8_t g_confirmedHop = NO_HOP;
+volatile unsigned long g_confirmedHopMicros = 0;
+
+// RPD samples out of SURVEY_SAMPLES that saw a carrier, per channel
+uint8_t g_occupancy[LINK_CHANNEL_COUNT];
+
+// Listen on each channel in turn and count how often RPD sees something above
+// -64 dBm. We hear nothing meanwhile (about 5 ms); controllers retry as usual.
+// Returns the quietest channel other than the current one, or NO_HOP if none is quieter
+// than the current one.
+uint8_t surveyChannels()
+{
+  digitalWrite(PIN_CE, LOW);
+  
+  uint8_t best = NO_HOP;
+  for (uint8_t i = 0; i < LINK_CHANNEL_COUNT; ++i)
+  {
+    radioWriteRegisterByte(RADIO_REG_RF_CH, g_channels[i]);
+    digitalWrite(PIN_CE, HIGH);
+    delayMicroseconds(SURVEY_SETTLE_MICROS);
+    
+    uint8_t busy = 0;
+    for (uint8_t sample = 0; sample < SURVEY_SAMPLES; ++sample)
+    {
+      delayMicroseconds(SURVEY_SAMPLE_MICROS);
+      busy += radioReadRegisterByte(RADIO_REG_RPD) & BIT0;
+    }
+    
+    digitalWrite(PIN_CE, LOW);
+    g_occupancy[i] = busy;
+    
+    if (i != g_channelIndex && (best == NO_HOP || busy < g_occupancy[best]))
+    {
+      best = i;
+    }
+  }
+  
+  radioWriteRegisterByte(RADIO_REG_RF_CH, g_channels[g_channelIndex]);
+  digitalWrite(PIN_CE, HIGH);
+  return g_occupancy[best] < g_occupancy[g_channelIndex] ? best : NO_HOP;
+}
+
+void reportSurvey(uint8_t best)
+{
+#ifdef SERIAL_TEXT_DUMP
+  Serial.print("Survey:");
+  for (uint8_t i = 0; i < LINK_CHANNEL_COUNT; ++i)
+  {
+    Serial.print(" ");
+    Serial.print(g_channels[i]);
+    Serial.print("=");
+    Serial.print(g_occupancy[i]);
+  }
+  if (best == NO_HOP)
+  {
+    Serial.print(", staying");
+  }
+  else
+  {
+    Serial.print(", offering ");
+    Serial.print(g_channels[best]);
+  }
+  Serial.print("\n\n");
+#else
+  uint8_t body[2 + LINK_CHANNEL_COUNT];
+  body[0] = g_channelIndex;
+  body[1] = best;
+  memcpy(&body[2], g_occupancy, LINK_CHANNEL_COUNT);
+  sendFrame(SERIAL_FRAME_SURVEY, (uint16_t)millis(), body, sizeof(body));
+#endif
+}
+
+// Called once the ACK of a controller's STATE_EXT_HOP_CONFIRM is out. Interrupts off.
+void switchChannel(uint8_t index)
+{
+  digitalWrite(PIN_CE, LOW);
+  radioWriteRegisterByte(RADIO_REG_RF_CH, g_channels[index]);
+  digitalWrite(PIN_CE, HIGH);
   
-  radioSetup();
+  g_channelIndex = index;
+  g_hopIndex = NO_HOP;
+  g_confirmedHop = NO_HOP;
+  g_hops++;
 }
 
-void handleRX_DR()
+// A controller that hasn't been heard from in this long is marked stale.
+// Awake controllers send a keepalive every second.
+#define SLOT_TIMEOUT_MILLIS 3000
+
+// How often loop() looks for stale slots
+#define SLOT_CHECK_MILLIS 100
+
+// Per-controller state, indexed by RX pipe
+struct ControllerSlot
 {
-  while(1)
-  {        
+  bool seen;                // at least one state packet received
+  bool fresh;               // heard from within SLOT_TIMEOUT_MILLIS
+  uint8_t seq;              // last state packet applied
+  uint8_t buttons;
+  unsigned long lastMillis;
+};
+
+ControllerSlot g_slots[LINK_UNIT_COUNT];
+unsigned long g_lastSlotCheck = 0;
+
+void updateLED()
+{
+  bool pressed = false;
+  for (uint8_t i = 0; i < LINK_UNIT_COUNT; ++i)
+  {
+    pressed = pressed || (g_slots[i].fresh && g_slots[i].buttons);
+  }
+  digitalWrite(PIN_LED, pressed ? HIGH : LOW);
+}
+
+// A key change the packets that carried it earlier didn't bring us (see
+// STATE_EXT_HISTORY), in a packet received at 'receivedTime'
+void applyChange(uint8_t pipe, const StateTransition& change, uint16_t receivedTime)
+{
+  g_slots[pipe].buttons = change.buttons;
+  
+#ifdef SERIAL_TEXT_DUMP
+  Serial.print("Recovered change on pipe ");
+  Serial.print(pipe);
+  Serial.print(": buttons ");
+  Serial.print(change.buttons, HEX);
+  Serial.print(", changed at ms ");
+  Serial.print((uint16_t)(receivedTime - change.age / STATE_TICKS_PER_MILLI));
+  Serial.print("\n");
+#else
+  uint8_t body[1 + sizeof(StateTransition)];
+  body[0] = pipe;
+  memcpy(&body[1], &change, sizeof(change));
+  sendFrame(SERIAL_FRAME_CHANGE, receivedTime, body, sizeof(body));
+#endif
+}
+
+void applyState(const RxEntry& entry)
+{
+  uint8_t pipe = entry.pipe;
+  ControllerSlot& slot = g_slots[pipe];
+  StatePacket state;
+  memcpy(&state, entry.payload, sizeof(state));
+  
+  // A slot that timed out may have missed anything, seqs starting over included
+  bool known = slot.seen && slot.fresh;
+  slot.lastMillis = millis();
+  slot.fresh = true;
+  
+  if (known && state.seq == slot.seq)
+  {
+    // Same packet again; nothing new to apply
+    return;
+  }
+  
+  // Changes before this state that came after the last packet we had, oldest first.
+  // Their ages are from this packet's time, like its own.
+  uint8_t count;
+  uint8_t offset = statePacketHistoryOffset(entry.payload, entry.size, &count);
+  for (uint8_t i = 0; offset && i < count; ++i)
+  {
+    StateTransition change;
+    memcpy(&change, entry.payload + offset + i * sizeof(change), sizeof(change));
+    if (!known || (int8_t)(change.seq - slot.seq) > 0)
+    {
+      applyChange(pipe, change, entry.time);
+    }
+  }
+  
+  slot.seen = true;
+  slot.seq = state.seq;
+  slot.buttons = state.buttons;
+  updateLED();
+}
+
+void checkSlotTimeouts()
+{
+  unsigned long now = millis();
+  if (now - g_lastSlotCheck < SLOT_CHECK_MILLIS)
+  {
+    return;
+  }
+  g_lastSlotCheck = now;
+  
+  bool changed = false;
+  for (uint8_t i = 0; i < LINK_UNIT_COUNT; ++i)
+  {
+    ControllerSlot& slot = g_slots[i];
+    if (slot.fresh && now - slot.lastMillis >= SLOT_TIMEOUT_MILLIS)
+    {
+      slot.fresh = false;
+      changed = true;
+      
+#ifdef SERIAL_TEXT_DUMP
+      Serial.print("Controller ");
+      Serial.print(i);
+      Serial.print(" timed out\n\n");
+#else
+      sendFrame(SERIAL_FRAME_TIMEOUT, (uint16_t)now, &i, 1);
+#endif
+    }
+  }
+  
+  if (changed)
+  {
+    updateLED();
+  }
+}
+
+// A state packet, possibly followed by StateExtensions
+bool isStatePacket(uint8_t pipe, uint8_t size)
+{
+  return pipe < LINK_UNIT_COUNT && size >= sizeof(StatePacket) && size <= STATE_PACKET_MAX_SIZE;
+}
+
+// Queue the echo of a state packet to go back with the next ACK on its pipe.
+// Returns STATUS as of the write.
+uint8_t loadAckPayload(uint8_t pipe, const StatePacket& state, uint8_t status)
+{
+  AckPacket ack;
+  ack.seq = state.seq;
+  ack.command = ACK_COMMAND_NONE;
+  ack.time = state.time;
+  ack.rxTime = (uint16_t)micros();
+  
+  // Every controller is told, so they all follow us
+  if (g_hopIndex != NO_HOP)
+  {
+    ack.command = ACK_COMMAND_HOP | g_hopIndex;
+  }
+  
+  // Each packet on a pipe takes that pipe's pending echo with its ACK, and the radio
+  // keeps it for a retransmit until the next new packet on the pipe, so normally
+  // there are two per active controller. The TX FIFO only holds three, though: with
+  // more controllers than one, drop the stale echoes rather than stall.
+  if (status & _BV(0))
+  {
+    radioFlushTX();
+  }
+  return radioWriteAckPayload(pipe, (uint8_t*)&ack, sizeof(ack));
+}
+
+// A controller on a burst profile sends each state as several NOACK copies (see
+// link_profile.h), all with the same seq; only the first goes in the ring. The same seq
+// again only counts as a copy for RX_COPY_MILLIS, so a controller that was reset and
+// started its seqs over isn't ignored. ISR only.
+//
+// Not on the ACKed profiles: there the radio drops a repeat with the same PID itself,
+// and a state the controller sends again after a MAX_RT (new PID, same seq) still needs
+// its ACK payload.
+#define RX_COPY_MILLIS 20
+
+bool g_pipeSeen[LINK_UNIT_COUNT];
+uint8_t g_pipeSeq[LINK_UNIT_COUNT];
+uint16_t g_pipeSeqTime[LINK_UNIT_COUNT];  // millis(), low 16 bits
+
+bool isCopy(uint8_t pipe, const uint8_t* packet, uint8_t size)
+{
+  if (!g_burstLink || !isStatePacket(pipe, size))
+  {
+    return false;
+  }
+  
+  StatePacket state;
+  memcpy(&state, packet, sizeof(state));
+  return g_pipeSeen[pipe] && state.seq == g_pipeSeq[pipe] &&
+         (uint16_t)((uint16_t)millis() - g_pipeSeqTime[pipe]) < RX_COPY_MILLIS;
+}
+
+// A packet went in the ring: its copies are the ones to drop
+void rememberSeq(uint8_t pipe, const uint8_t* packet, uint8_t size)
+{
+  if (!g_burstLink || !isStatePacket(pipe, size))
+  {
+    return;
+  }
+  
+  StatePacket state;
+  memcpy(&state, packet, sizeof(state));
+  g_pipeSeen[pipe] = true;
+  g_pipeSeq[pipe] = state.seq;
+  g_pipeSeqTime[pipe] = (uint16_t)millis();
+}
+
+// Empty the radio's RX FIFO into the ring. Runs in the IRQ handler, so no Serial here:
+// whatever loop() is printing, the radio gets drained as soon as a packet lands.
+//
+// Each packet costs two SPI transactions (width, payload) plus its ACK payload. The STATUS
+// byte that comes back with every command says whether the FIFO has more (RX_P_NO), so
+// there's no FIFO_STATUS read, and RX_DR is cleared once for the whole batch.
+//
+// A lone packet, the usual case, takes four, and that's as few as it gets: each command
+// is a CSN frame of its own, so the STATUS clear can't ride on another. It has to come
+// before the reads, for a packet landing after them to raise a new IRQ. The width
+// depends on the extensions, and each state's echo must be in place for the next ACK.
+void drainRadio()
+{
+  // Clear the IRQ up front: RX_DR, TX_DS for ACK payloads that went out, and MAX_RT
+  // (which a PRX never sets). A packet landing after this sets RX_DR again and gives a
+  // fresh IRQ edge, so none can be left behind in the FIFO.
+  uint8_t status = radioWriteRegisterByte(RADIO_REG_STATUS, _BV(6) | _BV(5) | _BV(4));
+  
+  uint8_t drained = 0;
+  uint8_t confirmedHop = NO_HOP;
+  
+  // Which pipe is the next packet from? (RX_P_NO; 0b111 means the FIFO is empty)
+  while (((status >> 1) & 0x07) != 0x07)
+  {
+    uint8_t pipe = (status >> 1) & 0x07;
+    ++drained;
+    
+    uint8_t head = g_rxHead;
+    bool ringFull = (uint8_t)(head - g_rxTail) >= RX_RING_SIZE;
+    RxEntry& entry = g_rxRing[head & (RX_RING_SIZE - 1)];
+    
     // How big is it?
-    uint8_t packetSize = radioGetRXPayloadWidth();
+    uint8_t packetSize = radioGetRXPayloadWidth(0);
     
     if (packetSize == 0 || packetSize > 32)
     {
-      Serial.print("Bad packet size: ");
-      Serial.print(packetSize);
-      Serial.print("\n");
       radioFlushRX();
-      radioWriteRegisterByte(RADIO_REG_STATUS, _BV(6));
-      return;
+      
+      if (ringFull)
+      {
+        g_rxRingOverflows++;
+        break;
+      }
+      entry.pipe = RX_RING_BAD_SIZE;
+      entry.size = packetSize;
+      entry.time = (uint16_t)millis();
+      g_rxHead = head + 1;
+      break;
     }
-  
-    uint8_t packet[32];
-    radioReadRXPayload(&packet[0], packetSize);
     
-    digitalWrite(PIN_LED, packet[0] ? HIGH : LOW);
+    // Read it even if there's no room in the ring, to free the radio's FIFO slot
+    uint8_t discard[32];
+    uint8_t* packet = ringFull ? discard : entry.payload;
+    radioReadRXPayload(packet, packetSize);
     
-    // Dump packet
-    Serial.print("Packet size: ");
-    Serial.print(packetSize);
-    Serial.print("\n");
-    for (int i=0; i<packetSize; ++i) {
-      Serial.print(packet[i], HEX);
-      Serial.print(",");
+    // Already in the ring, and a NOACK packet has no ACK to load
+    if (isCopy(pipe, packet, packetSize))
+    {
+      status = radioReadStatus();
+      continue;
     }
-    Serial.print("\n\n");
     
+    if (ringFull)
+    {
+      g_rxRingOverflows++;
+    }
+    else
+    {
+      entry.pipe = pipe;
+      entry.size = packetSize;
+      entry.time = (uint16_t)millis();
+      g_rxHead = head + 1;
+      rememberSeq(pipe, packet, packetSize);
+    }
     
-    // Clear the RX_DR IRQ
-    radioWriteRegisterByte(RADIO_REG_STATUS, _BV(6));
-    
-    // Check if there are more packets to read
-    uint8_t fifoStatus = radioReadRegisterByte(RADIO_REG_FIFO_STATUS);
-    if (fifoStatus & _BV(0))
+    // The next command's STATUS shows the packet after this one
+    if (isStatePacket(pipe, packetSize))
     {
-      // RX_EMPTY. We're done
-      return;
+      StatePacket state;
+      memcpy(&state, packet, sizeof(state));
+      
+      for (uint8_t i = sizeof(StatePacket); i + sizeof(StateExtension) <= packetSize;
+           i += stateExtensionSize(packet + i))
+      {
+        StateExtension ext;
+        memcpy(&ext, packet + i, sizeof(ext));
+        if (ext.type == STATE_EXT_HOP_REQUEST && g_hopIndex == NO_HOP)
+        {
+          g_surveyRequested = true;
+        }
+        else if (ext.type == STATE_EXT_HOP_CONFIRM && ext.arg < LINK_CHANNEL_COUNT)
+        {
+          confirmedHop = ext.arg;
+        }
+        else if (ext.type == STATE_EXT_TELEMETRY)
+        {
+          // The rest is LinkTelemetry, for reportEntry()
+          break;
+        }
+      }
+      
+      // A burst link has no ACKs to carry an echo
+      status = g_burstLink ? radioReadStatus() : loadAckPayload(pipe, state, status);
     }
     else
     {
-      continue;
+      status = radioReadStatus();
     }
   }
+  
+  // Three in one go: every slot was taken, so the radio may have turned packets away
+  if (drained >= 3)
+  {
+    g_rxFifoFull++;
+  }
+  
+  // loop() moves once the ACK is out. A repeat of the confirm (its ACK was lost)
+  // starts the wait over.
+  if (confirmedHop != NO_HOP && confirmedHop != g_channelIndex)
+  {
+    g_confirmedHop = confirmedHop;
+    g_confirmedHopMicros = micros();
+  }
+}
+
+ISR(PCINT0_vect)
+{
+  // Fires on both edges; the radio's IRQ is active low
+  if (!digitalRead(PIN_IRQ))
+  {
+    drainRadio();
+  }
+}
+
+void reportEntry(const RxEntry& entry)
+{
+  if (entry.pipe == RX_RING_BAD_SIZE)
+  {
+#ifdef SERIAL_TEXT_DUMP
+    Serial.print("Bad packet size: ");
+    Serial.print(entry.size);
+    Serial.print("\n");
+#else
+    sendFrame(SERIAL_FRAME_BAD_SIZE, entry.time, &entry.size, 1);
+#endif
+    return;
+  }
+  
+  if (isStatePacket(entry.pipe, entry.size))
+  {
+    applyState(entry);
+  }
+  
+#ifdef SERIAL_TEXT_DUMP
+  if (isStatePacket(entry.pipe, entry.size))
+  {
+    // When the buttons changed, on our clock
+    StatePacket state;
+    memcpy(&state, entry.payload, sizeof(state));
+    Serial.print("State age ticks: ");
+    Serial.print(state.age);
+    Serial.print(", changed at ms ");
+    Serial.print((uint16_t)(entry.time - state.age / STATE_TICKS_PER_MILLI));
+    Serial.print("\n");
+  }
+  
+  uint8_t telemetryOffset = isStatePacket(entry.pipe, entry.size) ?
+                            statePacketTelemetryOffset(entry.payload, entry.size) : 0;
+  if (telemetryOffset)
+  {
+    LinkTelemetry t;
+    memcpy(&t, entry.payload + telemetryOffset, sizeof(t));
+    Serial.print("Telemetry: sent ");
+    Serial.print(t.sent);
+    Serial.print(", acked ");
+    Serial.print(t.acked);
+    Serial.print(", MAX_RT ");
+    Serial.print(t.maxRT);
+    Serial.print(", PLOS ");
+    Serial.print(t.plos);
+    Serial.print(", ARC ");
+    Serial.print(t.arc);
+    Serial.print(", backoff ms ");
+    Serial.print(t.backoffMillis);
+    Serial.print(", keepalives ");
+    Serial.print(t.keepalives);
+    Serial.print(", wakes ");
+    Serial.print(t.wakes);
+    Serial.print("\n");
+  }
+  
+  // Dump packet
+  Serial.print("Pipe: ");
+  Serial.print(entry.pipe);
+  Serial.print("\n");
+  Serial.print("Packet size: ");
+  Serial.print(entry.size);
+  Serial.print("\n");
+  for (int i=0; i<entry.size; ++i) {
+    Serial.print(entry.payload[i], HEX);
+    Serial.print(",");
+  }
+  Serial.print("\n\n");
+#else
+  uint8_t body[33];
+  body[0] = entry.pipe;
+  memcpy(&body[1], entry.payload, entry.size);
+  sendFrame(SERIAL_FRAME_PACKET, entry.time, body, 1 + entry.size);
+#endif
+}
+
+void reportOverflows()
+{
+  noInterrupts();
+  uint16_t ringOverflows = g_rxRingOverflows;
+  uint16_t fifoFull = g_rxFifoFull;
+  interrupts();
+  
+  if (ringOverflows == g_reportedRingOverflows && fifoFull == g_reportedFifoFull)
+  {
+    return;
+  }
+  g_reportedRingOverflows = ringOverflows;
+  g_reportedFifoFull = fifoFull;
+  
+#ifdef SERIAL_TEXT_DUMP
+  Serial.print("Overflows: ring ");
+  Serial.print(ringOverflows);
+  Serial.print(", RX FIFO full ");
+  Serial.print(fifoFull);
+  Serial.print("\n\n");
+#else
+  uint16_t body[2] = { ringOverflows, fifoFull };
+  sendFrame(SERIAL_FRAME_OVERFLOW, (uint16_t)millis(), (uint8_t*)body, sizeof(body));
+#endif
+}
+
+void reportHops()
+{
+  uint8_t hops = g_hops;
+  if (hops == g_reportedHops)
+  {
+    return;
+  }
+  g_reportedHops = hops;
+  
+#ifdef SERIAL_TEXT_DUMP
+  Serial.print("Hopped to channel ");
+  Serial.print(g_channels[g_channelIndex]);
+  Serial.print("\n\n");
+#else
+  uint8_t body[2] = { g_channelIndex, hops };
+  sendFrame(SERIAL_FRAME_HOP, (uint16_t)millis(), body, sizeof(body));
+#endif
+}
+
+// Answer a hop request: survey with the radio IRQ masked (the drain would fight us for
+// the SPI bus) and offer the quietest channel in every ACK until someone confirms it.
+// Requests within HOP_OFFER_MILLIS of the last survey are dropped.
+void checkHop()
+{
+  if (g_hopIndex != NO_HOP && millis() - g_hopOfferedMillis >= HOP_OFFER_MILLIS)
+  {
+    g_hopIndex = NO_HOP;
+  }
+  
+  if (!g_surveyRequested)
+  {
+    return;
+  }
+  
+  if (g_surveyed && millis() - g_surveyMillis < HOP_OFFER_MILLIS)
+  {
+    g_surveyRequested = false;
+    return;
+  }
+  
+  PCMSK0 &= ~_BV(PCINT1);
+  uint8_t best = surveyChannels();
+  g_surveyRequested = false;
+  g_hopIndex = best;
+  g_hopOfferedMillis = millis();
+  PCMSK0 |= _BV(PCINT1);
+  
+  g_surveyMillis = g_hopOfferedMillis;
+  g_surveyed = true;
+  
+  reportSurvey(best);
 }
 
 void loop()
 {
-    if(!digitalRead(PIN_IRQ))
+    checkSlotTimeouts();
+    
+    // A missed edge (e.g. an IRQ already pending when the interrupt was enabled) would
+    // leave the pin low with no more edges coming, so mop up here too
+    noInterrupts();
+    if (!digitalRead(PIN_IRQ))
     {
-      uint8_t status = radioReadStatus();
-      
-      // RX_DR interrupt
-      if (status & _BV(6))
-      {
-        handleRX_DR();
-      }
-      else
-      {
-        // clear ALL interrupts -- we somehow transmitted something?
-        radioWriteRegisterByte(RADIO_REG_STATUS, _BV(6) | _BV(5) | _BV(4));
-      }
+      drainRadio();
+    }
+    
+    // After the drain, so the rest of the FIFO is read on the channel it arrived on
+    if (g_confirmedHop != NO_HOP && micros() - g_confirmedHopMicros >= g_hopSwitchMicros)
+    {
+      switchChannel(g_confirmedHop);
+    }
+    interrupts();
+    
+    while (g_rxTail != g_rxHead)
+    {
+      reportEntry(g_rxRing[g_rxTail & (RX_RING_SIZE - 1)]);
+      g_rxTail = g_rxTail + 1;
     }
+    
+    reportOverflows();
+    reportHops();
+    checkHop();
 }
 
@@ -13,8 +13,17 @@
 #define PIN_SCK 13
 #define PIN_LED 2
 
-#define halSpiBegin() do { SPI.begin(); digitalWrite(PIN_CSN, LOW); } while(0)
-#define halSpiEnd() do { SPI.end(); digitalWrite(PIN_CSN, HIGH); } while(0)
+// Link profile jumpers (see link_profile.h): a jumper to ground is a 1
+#define PIN_PROFILE0 4
+#define PIN_PROFILE1 5
+
+// SPI is set up once in setup(), so a transaction is just CSN, driven straight through
+// the port register: PIN_CSN is PB2.
+#define halSpiBegin() do { PORTB &= ~_BV(PB2); } while(0)
+#define halSpiEnd() do { PORTB |= _BV(PB2); } while(0)
 #define halSpiTransfer(_x) SPI.transfer(_x)
 
+// Back-to-back bytes, in place: sends buf and overwrites it with what comes back
+#define halSpiTransferBurst(_buf, _size) SPI.transfer(_buf, _size)
+
 #endif /* HAL_H */
@@ -1,5 +1,6 @@
 #include "radio.h"
 #include "hal.h"
+#include <string.h>
 
 uint8_t radioReadRegisterByte(uint8_t reg)
 {
@@ -21,33 +22,41 @@ void radioWriteRegister(uint8_t reg, uint8_t* data, int size)
     halSpiEnd();
 }
 
-void radioWriteRegisterByte(uint8_t reg, uint8_t value)
+uint8_t radioWriteRegisterByte(uint8_t reg, uint8_t value)
 {
     halSpiBegin();
-    halSpiTransfer(0x20 | (reg & 0x1F));
+    uint8_t status = halSpiTransfer(0x20 | (reg & 0x1F));
     halSpiTransfer(value);
     halSpiEnd();
+    return status;
+}
+
+void radioWriteRegisters(const RadioRegisterInit* regs, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        radioWriteRegisterByte(regs[i].reg, regs[i].value);
+    }
 }
 
 void radioReadRXPayload(uint8_t* dest, int size)
 {
+    memset(dest, 0xFF, size);
     halSpiBegin();
     halSpiTransfer(0x61);
-    for (; size > 0; --size, ++dest)
-    {
-        *dest = halSpiTransfer(0xFF);
-    }
+    halSpiTransferBurst(dest, size);
     halSpiEnd();
 }
 
 void radioWriteTXPayload(uint8_t* src, int size)
 {
+    // The burst overwrites its buffer
+    uint8_t buf[32];
+    memcpy(buf, src, size);
+
     halSpiBegin();
     halSpiTransfer(0xA0);
-    for (; size > 0; --size, ++src)
-    {
-        halSpiTransfer(*src);
-    }
+    halSpiTransferBurst(buf, size);
     halSpiEnd();
 }
 
@@ -72,24 +81,42 @@ void radioReuseTXPayload()
     halSpiEnd();
 }
 
-uint8_t radioGetRXPayloadWidth()
+uint8_t radioGetRXPayloadWidth(uint8_t* status)
 {
     halSpiBegin();
-    halSpiTransfer(0x60);
+    uint8_t first = halSpiTransfer(0x60);
     uint8_t value = halSpiTransfer(0xFF);
     halSpiEnd();
+    if (status)
+    {
+        *status = first;
+    }
     return value;
 }
 
 void radioWriteTXPayloadNoACK(uint8_t* src, int size)
 {
+    // The burst overwrites its buffer
+    uint8_t buf[32];
+    memcpy(buf, src, size);
+
     halSpiBegin();
     halSpiTransfer(0xB0);
-    for (; size > 0; --size, ++src)
-    {
-        halSpiTransfer(*src);
-    }
+    halSpiTransferBurst(buf, size);
+    halSpiEnd();
+}
+
+uint8_t radioWriteAckPayload(uint8_t pipe, uint8_t* src, int size)
+{
+    // The burst overwrites its buffer
+    uint8_t buf[32];
+    memcpy(buf, src, size);
+
+    halSpiBegin();
+    uint8_t status = halSpiTransfer(0xA8 | (pipe & 0x07));
+    halSpiTransferBurst(buf, size);
     halSpiEnd();
+    return status;
 }
 
 void radioNOP()
@@ -2,6 +2,7 @@
 #define RADIO_H
 
 #include <stdint.h>
+#include "../Common/radio_init.h"
 
 #define RADIO_REG_CONFIG      0x00
 #define RADIO_REG_EN_AA       0x01
@@ -30,16 +31,25 @@
 #define RADIO_REG_DYNPD       0x1C
 #define RADIO_REG_FEATURE     0x1D
 
+// Commands that return a uint8_t STATUS give back the STATUS byte the radio clocks out
+// while the command byte goes in, i.e. as it was before the command took effect.
+// STATUS RX_P_NO (bits 3:1) is the pipe of the packet at the head of the RX FIFO, or
+// 0b111 if the RX FIFO is empty.
+
 uint8_t radioReadRegisterByte(uint8_t reg);
-void radioWriteRegisterByte(uint8_t reg, uint8_t value);
+uint8_t radioWriteRegisterByte(uint8_t reg, uint8_t value);
+// radioWriteRegisterByte() for each entry of a LINK_RADIO_INIT() table
+void radioWriteRegisters(const RadioRegisterInit* regs, int count);
 void radioWriteRegister(uint8_t reg, uint8_t* data, int size);
 void radioReadRXPayload(uint8_t* dest, int size);
 void radioWriteTXPayload(uint8_t* src, int size);
 void radioFlushTX();
 void radioFlushRX();
 void radioReuseTXPayload();
-uint8_t radioGetRXPayloadWidth();
+// Also returns STATUS through 'status' if it isn't 0
+uint8_t radioGetRXPayloadWidth(uint8_t* status);
 void radioWriteTXPayload(uint8_t* src, int size);
+uint8_t radioWriteAckPayload(uint8_t pipe, uint8_t* src, int size);
 void radioNOP();
 uint8_t radioReadStatus();
 
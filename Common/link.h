@@ -0,0 +1,45 @@
+#ifndef LINK_H
+#define LINK_H
+
+// Radio addressing shared by the controller (SegaGenController) and the
+// receiver (ArduinoRX).
+//
+// One receiver serves up to six controllers, one per RX pipe. Controller unit n
+// transmits to the address of receiver pipe n. Pipe 0 has an address of its own;
+// pipes 1-5 share the upper bytes of pipe 1's and differ only in the LSByte, which
+// is the first byte written to the address registers. How many bytes an address has
+// depends on the link profile (see link_profile.h).
+
+#define LINK_UNIT_COUNT         6
+
+// The controller's four DIP switches, as halReadDIP() returns them (switch n in bit n).
+// Switches 0 and 1 are the unit, so a board reaches units 0-3; pipes 4 and 5 are there
+// for controllers with more switches. Switches 2 and 3 are the link profile (see
+// link_profile.h).
+#define LINK_DIP_UNIT(dip)      ((dip) & 0x03)
+#define LINK_DIP_PROFILE(dip)   (((dip) >> 2) & 0x03)
+
+// Unit 0 (pipe 0): E7E7E7, as the single-controller setup has always used (E7 in
+// every byte, however wide)
+#define LINK_UNIT0_ADDRESS_BYTE 0xE7
+
+// Units 1-5 (pipes 1-5): C2C2C2, C2C2C3 ... C2C2C6 (C2 in every byte above the LSByte)
+#define LINK_UNIT_ADDRESS_HIGH  0xC2
+#define LINK_UNIT_ADDRESS_LSB(unit) (LINK_UNIT_ADDRESS_HIGH + (unit) - 1)
+
+// RF channels (2400 + n MHz) the link may hop between. Both ends start on the first.
+// A Wi-Fi channel is 22 MHz wide, so it covers at most one of these: 3 is in Wi-Fi
+// channel 1 and 27 in 6, 50 falls between 6 and 11, and 85 on are above channel 13.
+#define LINK_CHANNEL_COUNT      6
+#define LINK_CHANNELS           { 3, 27, 50, 85, 100, 122 }
+
+// Hopping to a quieter channel (see packet.h):
+// 1. The controller sees too many packets lost (OBSERVE_TX) and adds a STATE_EXT_HOP_REQUEST.
+// 2. The receiver surveys the channels with RPD and answers with ACK_COMMAND_HOP.
+// 3. The controller sends STATE_EXT_HOP_CONFIRM with nothing else queued, and moves once
+//    it is ACKed (or given up on). The receiver moves once the ACK is out: a round trip
+//    of the link profile (linkProfileRoundTripMicros()) after reading the confirm.
+// A controller that loses the receiver anyway (e.g. the receiver moved for another
+// controller) tries each channel in turn until it gets through again.
+
+#endif /* LINK_H */
@@ -0,0 +1,98 @@
+#ifndef LINK_PROFILE_H
+#define LINK_PROFILE_H
+
+// Air-time link profiles shared by the controller (SegaGenController) and the
+// receiver (ArduinoRX). Both ends must use the same one: a radio only hears packets
+// sent at its own data rate, CRC length and address width.
+//
+// The controller picks its profile with DIP switches 2 and 3 (LINK_DIP_PROFILE; 0 and 1
+// are the unit, see link.h), the receiver with its two profile jumpers, so any of the
+// four can be set at either end.
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t rfSetup;        // RF_SETUP: data rate (RF_DR_LOW, RF_DR_HIGH) and RF_PWR
+    uint8_t crcLength;      // 1 or 2 bytes
+    uint8_t addressWidth;   // 3 to 5 bytes
+    uint8_t ard;            // SETUP_RETR ARD: wait (ard + 1) * 250 us for an ACK
+    uint8_t arc;            // SETUP_RETR ARC: retransmits the radio makes by itself
+    uint8_t copies;         // 0: states are ACKed; n: each goes out as n NOACK copies
+} LinkProfile;
+
+// RF_SETUP bits
+#define LINK_RF_250KBPS         0x20    // RF_DR_LOW
+#define LINK_RF_2MBPS           0x08    // RF_DR_HIGH
+#define LINK_RF_1MBPS           0x00
+#define LINK_RF_0DBM            0x06    // RF_PWR = 11
+
+// The four profiles, in the order of LINK_PROFILES below. The first three are ACKed,
+// with the radio retransmitting by itself; the last sends NOACK copies instead.
+//
+// 1 Mbps, 2-byte CRC and 3-byte addresses, as the link was before there were profiles.
+// ARD 250 us, ARC 5. The default, with no DIP switches or jumpers set.
+#define LINK_PROFILE_STANDARD       0
+// 2 Mbps and a 1-byte CRC: the shortest packets, at some cost in range. ARD 250 us,
+// ARC 6.
+#define LINK_PROFILE_LOW_LATENCY    1
+// 250 kbps (about 10 dB more sensitive than 1 Mbps), with 5-byte addresses so noise
+// is less likely to pass for a packet. An ACK with an AckPacket takes 484 us, so ARD
+// is 750 us; ARC 2.
+#define LINK_PROFILE_LONG_RANGE     2
+// Fire and forget: 2 Mbps and a 1-byte CRC, ARC 0, with each state sent as three
+// back-to-back NOACK copies (W_TX_PAYLOAD_NOACK) that the receiver drops the repeats
+// of. No ACK turnaround and no MAX_RT, so the latency doesn't depend on what gets lost
+// unless every copy is: then the receiver only hears of it with the next change or
+// keepalive. With no ACKs there are no ACK payloads either, so no hopping and no link
+// stats.
+// Selected with DIP switches 2 and 3 both on, and both receiver jumpers fitted.
+#define LINK_PROFILE_BURST          3
+
+// The radio retries a lost packet (or ACK) itself, ARC times, a state packet's air time
+// plus ARD apart, before MAX_RT hands it back to the controller's backoff. ARC gives
+// each data rate about 2 ms of retries: 6 x 355 us at 1 Mbps, 7 x 299 us at 2 Mbps and
+// 3 x 1234 us at 250 kbps. The burst profile has ARC 0: its NOACK copies get no ACKs,
+// so there is nothing to retry.
+#define LINK_PROFILE_COUNT      4
+#define LINK_PROFILES \
+    { \
+        { LINK_RF_1MBPS | LINK_RF_0DBM, 2, 3, 0, 5, 0 }, \
+        { LINK_RF_2MBPS | LINK_RF_0DBM, 1, 3, 0, 6, 0 }, \
+        { LINK_RF_250KBPS | LINK_RF_0DBM, 2, 5, 2, 2, 0 }, \
+        { LINK_RF_2MBPS | LINK_RF_0DBM, 1, 3, 0, 0, 3 }, \
+    }
+
+// The longest address any profile uses
+#define LINK_ADDRESS_MAX_WIDTH  5
+
+// Register values for a profile
+#define LINK_PROFILE_CONFIG_CRC(p)  ((p)->crcLength == 2 ? 0x0C : 0x08)    // EN_CRC, CRC0
+#define LINK_PROFILE_SETUP_AW(p)    ((p)->addressWidth - 2)
+#define LINK_PROFILE_SETUP_RETR(p)  (((p)->ard << 4) | (p)->arc)
+
+// Time from the end of a packet to the start of its ACK (PRX RX -> TX turnaround)
+#define LINK_ACK_TURNAROUND_MICROS  130
+
+static inline uint16_t linkProfileKbps(const LinkProfile* p)
+{
+    return (p->rfSetup & LINK_RF_250KBPS) ? 250 : (p->rfSetup & LINK_RF_2MBPS) ? 2000 : 1000;
+}
+
+// On-air time of a packet (or an ACK) carrying 'payloadSize' bytes: preamble, address,
+// 9-bit packet control field, payload and CRC.
+static inline uint16_t linkProfileAirMicros(const LinkProfile* p, uint8_t payloadSize)
+{
+    uint32_t bits = 8UL * (1 + p->addressWidth + payloadSize + p->crcLength) + 9;
+    return (uint16_t)((bits * 1000 + linkProfileKbps(p) - 1) / linkProfileKbps(p));
+}
+
+// Packet sent to its ACK (with 'ackPayloadSize' bytes) fully received
+static inline uint16_t linkProfileRoundTripMicros(const LinkProfile* p, uint8_t payloadSize,
+                                                  uint8_t ackPayloadSize)
+{
+    return linkProfileAirMicros(p, payloadSize) + LINK_ACK_TURNAROUND_MICROS +
+           linkProfileAirMicros(p, ackPayloadSize);
+}
+
+#endif /* LINK_PROFILE_H */
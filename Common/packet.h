@@ -0,0 +1,147 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+// Over-the-air payloads shared by the controller (SegaGenController) and the
+// receiver (ArduinoRX). 16-bit fields sit on even offsets and are little-endian, so
+// the layout is the same on the MSP430, the AVR and the host.
+
+#include <stdint.h>
+
+// Controller -> receiver: the current button state.
+// seq goes up by one for every packet the controller queues (wrapping at 256), so
+// the receiver can tell a new state from a repeat of the last one. Changes that came
+// and went before the receiver heard of them go along as STATE_EXT_HISTORY.
+//
+// age is how long the state had been waiting when the packet was queued: from the key
+// poll that saw it to the send, retries and backoff included (each try is queued
+// afresh). The press happened about that long before the packet arrived, give or take
+// a key poll interval and the few hundred us on air.
+typedef struct
+{
+    uint8_t seq;
+    uint8_t buttons;
+    uint16_t time;          // controller's halNow() when queued, low 16 bits
+    uint16_t age;           // in STATE_TICKS_PER_MILLI ticks; STATE_AGE_MAX or older
+} StatePacket;
+
+// The controller's timer: its VLO, nominally 12 kHz
+#define STATE_TICKS_PER_MILLI   12
+#define STATE_AGE_MAX           0xFFFF
+
+// A state packet may be followed by extensions, to ask the receiver for something or
+// to tell it something.
+typedef struct
+{
+    uint8_t type;           // STATE_EXT_*
+    uint8_t arg;
+} StateExtension;
+
+#define STATE_EXT_MAX           2
+
+// Packets are getting lost: please find a quieter channel (see link.h). arg unused.
+#define STATE_EXT_HOP_REQUEST   1
+// Moving to LINK_CHANNELS[arg] as soon as this packet is ACKed
+#define STATE_EXT_HOP_CONFIRM   2
+// arg bytes of LinkTelemetry follow. Always the last extension.
+#define STATE_EXT_TELEMETRY     3
+// arg StateTransitions follow, oldest first: the key changes before the current state
+// that the receiver may not have heard of. Never in the same packet as telemetry.
+#define STATE_EXT_HISTORY       4
+
+// A key change carried by a later packet, so it isn't lost along with the packets that
+// carried it before. seq is the first packet that did: a receiver that has already
+// seen that packet (or a later one) already has the change.
+typedef struct
+{
+    uint8_t seq;
+    uint8_t buttons;        // the state after the change
+    uint16_t age;           // how long before StatePacket.time, as StatePacket.age
+} StateTransition;
+
+#define STATE_HISTORY_MAX       4
+
+// Controller -> receiver, with keepalives and the first packet after waking: running
+// totals since power-on, wrapping at 65536. Tells RF loss apart from the firmware
+// holding things up.
+typedef struct
+{
+    uint16_t sent;          // state packets queued, first tries and resends; a burst counts once
+    uint16_t acked;
+    uint16_t maxRT;         // sends that got no ACK
+    uint16_t plos;          // OBSERVE_TX PLOS_CNT: packets lost
+    uint16_t arc;           // OBSERVE_TX ARC_CNT of each packet: the radio's own retransmits
+    uint16_t backoffMillis; // time spent waiting after failures
+    uint16_t keepalives;
+    uint16_t wakes;         // awake periods, counting the one after power-on
+} LinkTelemetry;
+
+// Largest state packet: a hop extension, then telemetry or a full history (the larger;
+// both are 16 bytes)
+#define STATE_PACKET_MAX_SIZE   (sizeof(StatePacket) + STATE_EXT_MAX * sizeof(StateExtension) + \
+                                 (sizeof(LinkTelemetry) > STATE_HISTORY_MAX * sizeof(StateTransition) ? \
+                                  sizeof(LinkTelemetry) : STATE_HISTORY_MAX * sizeof(StateTransition)))
+
+// Bytes from the extension at 'ext' to the next one: the extension and what follows it
+static inline uint8_t stateExtensionSize(const uint8_t* ext)
+{
+    if (ext[0] == STATE_EXT_HISTORY)
+    {
+        return sizeof(StateExtension) + ext[1] * sizeof(StateTransition);
+    }
+    return ext[0] == STATE_EXT_TELEMETRY ? sizeof(StateExtension) + ext[1] : sizeof(StateExtension);
+}
+
+// Offset of the data that follows extension 'type' in a state packet 'size' bytes long,
+// or 0 if it has none or the data doesn't fit. *arg gets the extension's arg.
+static inline uint8_t statePacketExtensionOffset(const uint8_t* payload, uint8_t size, uint8_t type,
+                                                 uint8_t* arg)
+{
+    for (uint8_t i = sizeof(StatePacket); i + sizeof(StateExtension) <= size; i += stateExtensionSize(payload + i))
+    {
+        if (payload[i] == type)
+        {
+            *arg = payload[i + 1];
+            return i + stateExtensionSize(payload + i) <= size ? i + sizeof(StateExtension) : 0;
+        }
+    }
+    return 0;
+}
+
+// Offset of the LinkTelemetry in a state packet 'size' bytes long, or 0 if it has none
+static inline uint8_t statePacketTelemetryOffset(const uint8_t* payload, uint8_t size)
+{
+    uint8_t arg = 0;
+    uint8_t offset = statePacketExtensionOffset(payload, size, STATE_EXT_TELEMETRY, &arg);
+    return arg == sizeof(LinkTelemetry) ? offset : 0;
+}
+
+// Offset of the StateTransitions in a state packet 'size' bytes long, or 0 if it has
+// none. *count gets how many there are.
+static inline uint8_t statePacketHistoryOffset(const uint8_t* payload, uint8_t size, uint8_t* count)
+{
+    uint8_t offset = statePacketExtensionOffset(payload, size, STATE_EXT_HISTORY, count);
+    return offset && *count <= STATE_HISTORY_MAX ? offset : 0;
+}
+
+// Receiver -> controller, as the ACK payload (EN_ACK_PAY).
+// The radio sends an ACK payload with the ACK of the *next* packet on the pipe, so
+// this describes the last state packet the receiver had processed by then.
+// The ACK has to be back within the link profile's ARD (link_profile.h): at 1 Mbps
+// that's 250 us, so there's no room to grow this.
+typedef struct
+{
+    uint8_t seq;            // echo of StatePacket.seq
+    uint8_t command;        // ACK_COMMAND_*, with its argument in the low nibble
+    uint16_t time;          // echo of StatePacket.time
+    uint16_t rxTime;        // receiver's micros() when it read the packet, low 16 bits
+} AckPacket;
+
+// Receiver -> controller control messages
+#define ACK_COMMAND_MASK    0xF0
+#define ACK_COMMAND_ARG(command) ((command) & 0x0F)
+
+#define ACK_COMMAND_NONE    0x00
+// Hop to LINK_CHANNELS[arg] (answers STATE_EXT_HOP_REQUEST)
+#define ACK_COMMAND_HOP     0x10
+
+#endif /* PACKET_H */
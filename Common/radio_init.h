@@ -0,0 +1,82 @@
+#ifndef RADIO_INIT_H
+#define RADIO_INIT_H
+
+// The nRF24L01+ configuration, shared by the controller (SegaGenController) and the
+// receiver (ArduinoRX) so the settings that decide whether they can hear each other
+// are only written down once. The register names are each side's own RADIO_REG_*
+// (radio.h).
+//
+// LINK_RADIO_INIT() builds the single-byte registers as a table that each side applies
+// in one loop. The address registers depend on the unit and are written separately,
+// from linkUnitAddress().
+
+#include <stdint.h>
+#include <string.h>
+#include "link.h"
+#include "link_profile.h"
+
+typedef struct
+{
+    uint8_t reg;
+    uint8_t value;
+} RadioRegisterInit;
+
+// Controller (PTX) and receiver (PRX), for LINK_RADIO_INIT's 'primRx'
+#define LINK_RADIO_PTX          0x00
+#define LINK_RADIO_PRX          0x01
+
+// 'pipes' is the mask of RX pipes in use: pipe 0 on the controller, where its ACKs
+// come back, and one per unit on the receiver.
+//
+// CONFIG
+//   7   Reserved       = 0
+//   6   MASK_RX_DR     = 0: enable RX interrupt
+//   5   MASK_TX_DR     = 0: enable TX complete interrupt
+//   4   MASK_MAX_RT    = 0: enable TX max retries interrupt
+//   3   EN_CRC         = 1: enable CRC
+//   2   CRC0           = profile: 1- or 2-byte CRC
+//   1   PWR_UP         = 1: power up
+//   0   PRIM_RX        = primRx
+// EN_AA, EN_RXADDR, DYNPD: auto-ACK, receive and dynamic payload length on 'pipes'
+// SETUP_AW, SETUP_RETR: address width, ACK wait and auto retransmits from the profile
+// RF_CH: 'channel' (2400 + n MHz)
+// RF_SETUP
+//   7   CONT_WAVE      = 0: Continuous carrier transmit off (we are not in test mode)
+//   5,3 RF_DR_LOW/HIGH = profile: data rate
+//   4   PLL_LOCK       = 0: Do not force PLL lock (we are not in test mode)
+//   2:1 RF_PWR         = profile: output power
+// FEATURE
+//   2   EN_DPL         = 1: Enable dynamic payload length
+//   1   EN_ACK_PAY     = 1: Enable ACK payload (the receiver's echo comes back in the ACKs)
+//   0   EN_DYN_ACK     = 1: Allow W_TX_PAYLOAD_NOACK (burst profiles' copies)
+#define LINK_RADIO_INIT(profile, channel, pipes, primRx) \
+    { \
+        { RADIO_REG_CONFIG,     (uint8_t)(LINK_PROFILE_CONFIG_CRC(profile) | 0x02 | (primRx)) }, \
+        { RADIO_REG_EN_AA,      (pipes) }, \
+        { RADIO_REG_EN_RXADDR,  (pipes) }, \
+        { RADIO_REG_SETUP_AW,   (uint8_t)LINK_PROFILE_SETUP_AW(profile) }, \
+        { RADIO_REG_SETUP_RETR, (uint8_t)LINK_PROFILE_SETUP_RETR(profile) }, \
+        { RADIO_REG_RF_CH,      (channel) }, \
+        { RADIO_REG_RF_SETUP,   (profile)->rfSetup }, \
+        { RADIO_REG_DYNPD,      (pipes) }, \
+        { RADIO_REG_FEATURE,    0x07 }, \
+    }
+
+#define LINK_RADIO_INIT_COUNT   9
+
+// Unit n's address (see link.h), LSByte first. Fills LINK_ADDRESS_MAX_WIDTH bytes; the
+// radio takes the profile's addressWidth of them.
+static inline void linkUnitAddress(uint8_t unit, uint8_t* addr)
+{
+    if (unit == 0)
+    {
+        memset(addr, LINK_UNIT0_ADDRESS_BYTE, LINK_ADDRESS_MAX_WIDTH);
+    }
+    else
+    {
+        memset(addr, LINK_UNIT_ADDRESS_HIGH, LINK_ADDRESS_MAX_WIDTH);
+        addr[0] = LINK_UNIT_ADDRESS_LSB(unit);
+    }
+}
+
+#endif /* RADIO_INIT_H */
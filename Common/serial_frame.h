@@ -0,0 +1,79 @@
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+// Binary stream from the receiver (ArduinoRX) to the PC over its serial port.
+//
+// Each frame is a SerialFrameHeader followed by a body that depends on the type. The
+// frame is COBS-encoded (so it contains no zero bytes) and then terminated with a
+// single 0. A reader that starts mid-stream, or loses bytes, resyncs at the next 0.
+// Multi-byte fields are little-endian, as in packet.h.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct
+{
+    uint8_t type;           // SERIAL_FRAME_*
+    uint8_t seq;            // goes up by one for every frame, so the PC can spot drops
+    uint16_t time;          // receiver's millis() when the frame was queued, low 16 bits
+} SerialFrameHeader;
+
+// Body: RX pipe (1 byte), then the radio payload as received
+#define SERIAL_FRAME_PACKET     1
+// Body: RX pipe (1 byte) of a controller that has gone quiet
+#define SERIAL_FRAME_TIMEOUT    2
+// Body: the bad payload width (1 byte). The RX FIFO was flushed.
+#define SERIAL_FRAME_BAD_SIZE   3
+// Body: two uint16_t running totals, sent when either changes: packets dropped because
+// the receiver's queue was full, then drains that found the radio's RX FIFO full
+#define SERIAL_FRAME_OVERFLOW   4
+// Body: current channel index, the index offered to the controllers (SERIAL_SURVEY_NO_HOP
+// if no channel was quieter), then per channel the RPD samples (out of 16) that saw a
+// carrier. Indexes are into LINK_CHANNELS.
+#define SERIAL_FRAME_SURVEY     5
+#define SERIAL_SURVEY_NO_HOP    0xFF
+// Body: the channel index moved to, then the running count of hops
+#define SERIAL_FRAME_HOP        6
+// Body: RX pipe (1 byte), then a StateTransition (packet.h) that the packets which
+// carried it before never brought us, recovered from a later packet's STATE_EXT_HISTORY.
+// Its age is from the frame's time. Sent just before that later packet's PACKET frame.
+#define SERIAL_FRAME_CHANGE     7
+
+#define SERIAL_FRAME_DELIMITER  0
+
+// Largest decoded frame: a PACKET with a full 32-byte payload
+#define SERIAL_FRAME_MAX_SIZE   (sizeof(SerialFrameHeader) + 1 + 32)
+
+// COBS adds at most one byte per 254, plus the delimiter
+#define SERIAL_FRAME_MAX_ENCODED_SIZE(size) ((size) + (size) / 254 + 2)
+
+// COBS-encodes 'size' bytes from src into dest and appends the delimiter.
+// dest needs SERIAL_FRAME_MAX_ENCODED_SIZE(size) bytes. Returns the bytes written.
+static inline size_t serialFrameEncode(const uint8_t* src, size_t size, uint8_t* dest)
+{
+    size_t out = 1;
+    size_t code = 0;        // where the current block's length byte goes
+    uint8_t blockSize = 1;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (src[i] != 0)
+        {
+            dest[out++] = src[i];
+            ++blockSize;
+        }
+
+        if (src[i] == 0 || blockSize == 0xFF)
+        {
+            dest[code] = blockSize;
+            code = out++;
+            blockSize = 1;
+        }
+    }
+
+    dest[code] = blockSize;
+    dest[out++] = SERIAL_FRAME_DELIMITER;
+    return out;
+}
+
+#endif /* SERIAL_FRAME_H */
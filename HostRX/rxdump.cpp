@@ -0,0 +1,390 @@
+// Prints the receiver's binary serial stream as text, one line per frame.
+//
+//   g++ -Wall rxdump.cpp serial_decoder.cpp -lutil -o rxdump
+//   rxdump /dev/ttyACM0     read the receiver (set to raw 115200 8N1)
+//   rxdump < capture.bin    read a capture, e.g. HOST_RX_SERIAL from the host sim
+//   rxdump --bench [frames] decoder throughput through a pty, standing in for the port
+//
+// Statistics go to stderr at the end.
+
+#include "serial_decoder.h"
+#include "../Common/packet.h"
+#include "../Common/link.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pty.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_FRAMES    100000
+
+static const uint8_t g_channels[LINK_CHANNEL_COUNT] = LINK_CHANNELS;
+
+// Age of each new button state when it was sent (StatePacket.age): how long presses took
+// to get going, retries included. Bucket i counts ages under g_ageBucketMillis[i].
+#define AGE_BUCKETS 8
+static const uint16_t g_ageBucketMillis[AGE_BUCKETS - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+static uint32_t g_ageHistogram[AGE_BUCKETS];
+static uint8_t g_lastButtons[LINK_UNIT_COUNT];
+static bool g_lastButtonsValid[LINK_UNIT_COUNT];
+
+static void countAge(uint8_t pipe, const StatePacket& state)
+{
+    if (pipe >= LINK_UNIT_COUNT || (g_lastButtonsValid[pipe] && state.buttons == g_lastButtons[pipe]))
+    {
+        return;
+    }
+
+    g_lastButtons[pipe] = state.buttons;
+    g_lastButtonsValid[pipe] = true;
+
+    int bucket = 0;
+    while (bucket < AGE_BUCKETS - 1 && state.age >= g_ageBucketMillis[bucket] * STATE_TICKS_PER_MILLI)
+    {
+        ++bucket;
+    }
+    g_ageHistogram[bucket]++;
+}
+
+// Key changes that only reached us in a later packet's STATE_EXT_HISTORY, as the
+// receiver reports them (SERIAL_FRAME_CHANGE)
+static uint32_t g_recoveredChanges;
+
+static void printHistory(uint16_t time, const uint8_t* payload, uint8_t size)
+{
+    uint8_t count;
+    uint8_t offset = statePacketHistoryOffset(payload, size, &count);
+    if (!offset)
+    {
+        return;
+    }
+
+    printf(" [history:");
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        StateTransition change;
+        memcpy(&change, payload + offset + i * sizeof(change), sizeof(change));
+        printf("%s %02x at %u", i ? "," : "", change.buttons, (uint16_t)(time - change.age / STATE_TICKS_PER_MILLI));
+    }
+    printf("]");
+}
+
+static void printFrame(const SerialFrame& frame)
+{
+    printf("%5u #%3u ", frame.header.time, frame.header.seq);
+
+    switch (frame.header.type)
+    {
+    case SERIAL_FRAME_PACKET:
+        if (frame.bodySize >= 1 + sizeof(StatePacket) && frame.bodySize <= 1 + STATE_PACKET_MAX_SIZE)
+        {
+            StatePacket state;
+            memcpy(&state, frame.body + 1, sizeof(state));
+            // The press, on the receiver's clock: its time less the state's age
+            printf("pipe %u state seq %3u buttons %02x time %u age %.1f ms (at %u)",
+                   frame.body[0], state.seq, state.buttons, state.time,
+                   (double)state.age / STATE_TICKS_PER_MILLI,
+                   (uint16_t)(frame.header.time - state.age / STATE_TICKS_PER_MILLI));
+            countAge(frame.body[0], state);
+
+            for (size_t i = 1 + sizeof(state); i + sizeof(StateExtension) <= frame.bodySize;
+                 i += stateExtensionSize(frame.body + i))
+            {
+                StateExtension ext;
+                memcpy(&ext, frame.body + i, sizeof(ext));
+                if (ext.type == STATE_EXT_TELEMETRY)
+                {
+                    uint8_t offset = statePacketTelemetryOffset(frame.body + 1, frame.bodySize - 1);
+                    if (offset)
+                    {
+                        LinkTelemetry t;
+                        memcpy(&t, frame.body + 1 + offset, sizeof(t));
+                        printf(" [telemetry: sent %u acked %u MAX_RT %u PLOS %u ARC %u"
+                               " backoff %u ms keepalives %u wakes %u]",
+                               t.sent, t.acked, t.maxRT, t.plos, t.arc, t.backoffMillis,
+                               t.keepalives, t.wakes);
+                    }
+                    break;
+                }
+                else if (ext.type == STATE_EXT_HOP_REQUEST)
+                {
+                    printf(" [hop request]");
+                }
+                else if (ext.type == STATE_EXT_HOP_CONFIRM && ext.arg < LINK_CHANNEL_COUNT)
+                {
+                    printf(" [hop to %u]", g_channels[ext.arg]);
+                }
+                else if (ext.type == STATE_EXT_HISTORY)
+                {
+                    printHistory(frame.header.time, frame.body + 1, frame.bodySize - 1);
+                }
+                else
+                {
+                    printf(" [ext %u %u]", ext.type, ext.arg);
+                }
+            }
+            printf("\n");
+            return;
+        }
+
+        printf("pipe %u packet", frame.bodySize ? frame.body[0] : 0);
+        for (size_t i = 1; i < frame.bodySize; ++i)
+        {
+            printf(" %02x", frame.body[i]);
+        }
+        printf("\n");
+        return;
+
+    case SERIAL_FRAME_TIMEOUT:
+        printf("pipe %u timed out\n", frame.bodySize ? frame.body[0] : 0);
+        return;
+
+    case SERIAL_FRAME_BAD_SIZE:
+        printf("bad packet size %u\n", frame.bodySize ? frame.body[0] : 0);
+        return;
+
+    case SERIAL_FRAME_OVERFLOW:
+        if (frame.bodySize == 4)
+        {
+            printf("overflows: %u dropped from the queue, %u RX FIFO full\n",
+                   frame.body[0] | (frame.body[1] << 8), frame.body[2] | (frame.body[3] << 8));
+            return;
+        }
+        break;
+
+    case SERIAL_FRAME_SURVEY:
+        if (frame.bodySize == 2 + LINK_CHANNEL_COUNT && frame.body[0] < LINK_CHANNEL_COUNT &&
+            (frame.body[1] < LINK_CHANNEL_COUNT || frame.body[1] == SERIAL_SURVEY_NO_HOP))
+        {
+            printf("survey on %u:", g_channels[frame.body[0]]);
+            for (int i = 0; i < LINK_CHANNEL_COUNT; ++i)
+            {
+                printf(" %u=%u", g_channels[i], frame.body[2 + i]);
+            }
+            if (frame.body[1] == SERIAL_SURVEY_NO_HOP)
+            {
+                printf(", staying\n");
+            }
+            else
+            {
+                printf(", offering %u\n", g_channels[frame.body[1]]);
+            }
+            return;
+        }
+        break;
+
+    case SERIAL_FRAME_HOP:
+        if (frame.bodySize == 2 && frame.body[0] < LINK_CHANNEL_COUNT)
+        {
+            printf("hopped to channel %u (hop %u)\n", g_channels[frame.body[0]], frame.body[1]);
+            return;
+        }
+        break;
+
+    case SERIAL_FRAME_CHANGE:
+        if (frame.bodySize == 1 + sizeof(StateTransition))
+        {
+            StateTransition change;
+            memcpy(&change, frame.body + 1, sizeof(change));
+            printf("pipe %u change seq %3u buttons %02x (at %u), recovered from history\n",
+                   frame.body[0], change.seq, change.buttons,
+                   (uint16_t)(frame.header.time - change.age / STATE_TICKS_PER_MILLI));
+            g_recoveredChanges++;
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    printf("unknown frame type %u (%u bytes)\n", frame.header.type, (unsigned)frame.bodySize);
+}
+
+static void printStats(const SerialDecoder& decoder)
+{
+    fprintf(stderr, "%llu bytes, %u frames, %u bad, %u dropped\n",
+            (unsigned long long)decoder.m_statBytes, decoder.m_statFrames,
+            decoder.m_statBadFrames, decoder.m_statDroppedFrames);
+}
+
+static void printAgeHistogram()
+{
+    uint32_t total = 0;
+    for (int i = 0; i < AGE_BUCKETS; ++i)
+    {
+        total += g_ageHistogram[i];
+    }
+    if (!total)
+    {
+        return;
+    }
+
+    fprintf(stderr, "state age when sent, %u new states:\n", total);
+    for (int i = 0; i < AGE_BUCKETS; ++i)
+    {
+        if (i < AGE_BUCKETS - 1)
+        {
+            fprintf(stderr, "  < %3u ms", g_ageBucketMillis[i]);
+        }
+        else
+        {
+            fprintf(stderr, "  >=%3u ms", g_ageBucketMillis[AGE_BUCKETS - 2]);
+        }
+        fprintf(stderr, " %6u (%.1f%%)\n", g_ageHistogram[i], 100.0 * g_ageHistogram[i] / total);
+    }
+}
+
+static void readAll(int fd, SerialDecoder& decoder)
+{
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        decoder.feed(buf, n);
+    }
+}
+
+static void setRaw(int fd, speed_t baud)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+        return;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud);
+    cfsetospeed(&tio, baud);
+    tcsetattr(fd, TCSANOW, &tio);
+}
+
+// Writes 'frames' state-packet frames into one end of a pty, the way the receiver
+// would, and decodes them from the other end as fast as they arrive.
+static int bench(int frames)
+{
+    int master, slave;
+    if (openpty(&master, &slave, 0, 0, 0) != 0)
+    {
+        perror("openpty");
+        return 1;
+    }
+    setRaw(slave, B115200);
+    setRaw(master, B115200);
+
+    pid_t writer = fork();
+    if (writer < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+
+    if (writer == 0)
+    {
+        close(slave);
+
+        // A delimiter first, so the reader is synced for frame 0
+        uint8_t delimiter = SERIAL_FRAME_DELIMITER;
+        if (write(master, &delimiter, 1) != 1)
+        {
+            _exit(1);
+        }
+
+        uint8_t frame[SERIAL_FRAME_MAX_SIZE];
+        uint8_t encoded[SERIAL_FRAME_MAX_ENCODED_SIZE(SERIAL_FRAME_MAX_SIZE)];
+        for (int i = 0; i < frames; ++i)
+        {
+            SerialFrameHeader header = { SERIAL_FRAME_PACKET, (uint8_t)i, (uint16_t)i };
+            StatePacket state = { (uint8_t)i, (uint8_t)(i >> 8), (uint16_t)(i * 12), 0 };
+            uint8_t pipe = i % LINK_UNIT_COUNT;
+
+            memcpy(frame, &header, sizeof(header));
+            frame[sizeof(header)] = pipe;
+            memcpy(frame + sizeof(header) + 1, &state, sizeof(state));
+
+            size_t size = serialFrameEncode(frame, sizeof(header) + 1 + sizeof(state), encoded);
+            if (write(master, encoded, size) != (ssize_t)size)
+            {
+                _exit(1);
+            }
+        }
+
+        // Let the reader drain before the pty goes away
+        tcdrain(master);
+        sleep(1);
+        _exit(0);
+    }
+
+    close(master);
+
+    SerialDecoder decoder;
+    uint32_t stateFrames = 0;
+    decoder.m_onFrame = [&](const SerialFrame& frame)
+    {
+        stateFrames += frame.header.type == SERIAL_FRAME_PACKET;
+    };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint8_t buf[4096];
+    while (decoder.m_statFrames + decoder.m_statBadFrames < (uint32_t)frames)
+    {
+        ssize_t n = read(slave, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            break;
+        }
+        decoder.feed(buf, n);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    waitpid(writer, 0, 0);
+    close(slave);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    printStats(decoder);
+    fprintf(stderr, "%.3f s: %.0f frames/s, %.0f bytes/s (115200 baud is 11520 bytes/s)\n",
+            seconds, stateFrames / seconds, decoder.m_statBytes / seconds);
+
+    return stateFrames == (uint32_t)frames && decoder.m_statBadFrames == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return bench(argc >= 3 ? atoi(argv[2]) : BENCH_DEFAULT_FRAMES);
+    }
+
+    int fd = 0;
+    if (argc >= 2)
+    {
+        fd = open(argv[1], O_RDONLY | O_NOCTTY);
+        if (fd < 0)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    if (isatty(fd))
+    {
+        setRaw(fd, B115200);
+    }
+
+    SerialDecoder decoder;
+    decoder.m_onFrame = printFrame;
+    readAll(fd, decoder);
+
+    printStats(decoder);
+    printAgeHistogram();
+    if (g_recoveredChanges)
+    {
+        fprintf(stderr, "%u key changes recovered from state history\n", g_recoveredChanges);
+    }
+    return 0;
+}
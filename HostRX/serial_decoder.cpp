@@ -0,0 +1,110 @@
+#include "serial_decoder.h"
+
+#include <string.h>
+
+int serialFrameDecode(const uint8_t* src, size_t size, uint8_t* dest)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < size)
+    {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > size)
+        {
+            return -1;
+        }
+
+        for (uint8_t i = 1; i < code; ++i)
+        {
+            if (src[in] == 0)
+            {
+                return -1;
+            }
+            dest[out++] = src[in++];
+        }
+
+        // Every block but a full one ends in an implied zero, except at the very end
+        if (code != 0xFF && in < size)
+        {
+            dest[out++] = 0;
+        }
+    }
+
+    return (int)out;
+}
+
+SerialDecoder::SerialDecoder()
+    : m_statBytes(0),
+      m_statFrames(0),
+      m_statBadFrames(0),
+      m_statDroppedFrames(0),
+      m_size(0),
+      m_synced(false),
+      m_overflow(false),
+      m_haveSeq(false),
+      m_lastSeq(0)
+{
+}
+
+void SerialDecoder::feed(const uint8_t* data, size_t size)
+{
+    m_statBytes += size;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (data[i] == SERIAL_FRAME_DELIMITER)
+        {
+            if (m_synced)
+            {
+                endFrame();
+            }
+            m_synced = true;
+            m_size = 0;
+            m_overflow = false;
+        }
+        else if (m_size < sizeof(m_buffer))
+        {
+            m_buffer[m_size++] = data[i];
+        }
+        else
+        {
+            m_overflow = true;
+        }
+    }
+}
+
+void SerialDecoder::endFrame()
+{
+    if (m_size == 0)
+    {
+        // Back-to-back delimiters: nothing in between, not an error
+        return;
+    }
+
+    uint8_t decoded[sizeof(m_buffer)];
+    int decodedSize = m_overflow ? -1 : serialFrameDecode(m_buffer, m_size, decoded);
+    if (decodedSize < (int)sizeof(SerialFrameHeader) || decodedSize > (int)SERIAL_FRAME_MAX_SIZE)
+    {
+        m_statBadFrames++;
+        return;
+    }
+
+    SerialFrame frame;
+    memcpy(&frame.header, decoded, sizeof(frame.header));
+    frame.body = decoded + sizeof(frame.header);
+    frame.bodySize = decodedSize - sizeof(frame.header);
+
+    if (m_haveSeq)
+    {
+        m_statDroppedFrames += (uint8_t)(frame.header.seq - m_lastSeq - 1);
+    }
+    m_haveSeq = true;
+    m_lastSeq = frame.header.seq;
+    m_statFrames++;
+
+    if (m_onFrame)
+    {
+        m_onFrame(frame);
+    }
+}
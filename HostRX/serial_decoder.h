@@ -0,0 +1,53 @@
+#ifndef SERIAL_DECODER_H
+#define SERIAL_DECODER_H
+
+// PC side of the receiver's binary serial stream (Common/serial_frame.h).
+//
+// Feed it bytes as they come off the serial port, in chunks of any size; it calls
+// m_onFrame for every complete, well-formed frame. Bytes before the first delimiter
+// are discarded, since the stream may have been opened mid-frame.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#include "../Common/serial_frame.h"
+
+struct SerialFrame
+{
+    SerialFrameHeader header;
+    const uint8_t* body;    // valid only during the callback
+    size_t bodySize;
+};
+
+class SerialDecoder
+{
+public:
+    SerialDecoder();
+
+    void feed(const uint8_t* data, size_t size);
+
+    std::function<void(const SerialFrame&)> m_onFrame;
+
+    // Statistics
+    uint64_t m_statBytes;
+    uint32_t m_statFrames;
+    uint32_t m_statBadFrames;       // bad COBS, too short or too long
+    uint32_t m_statDroppedFrames;   // gaps in header.seq
+
+private:
+    void endFrame();
+
+    uint8_t m_buffer[SERIAL_FRAME_MAX_ENCODED_SIZE(SERIAL_FRAME_MAX_SIZE)];
+    size_t m_size;
+    bool m_synced;
+    bool m_overflow;
+    bool m_haveSeq;
+    uint8_t m_lastSeq;
+};
+
+// Decodes one COBS block sequence (no delimiter) into dest, which needs 'size' bytes.
+// Returns the decoded size, or -1 if the encoding is invalid.
+int serialFrameDecode(const uint8_t* src, size_t size, uint8_t* dest);
+
+#endif // SERIAL_DECODER_H
@@ -0,0 +1,109 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Just enough of the Arduino core to run ArduinoRX on the host. See arduino_host.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+
+#define _BV(bit) (1 << (bit))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void interrupts();
+void noInterrupts();
+
+// An AVR output port register. Reads give back what was last written; writes drive the
+// Arduino pins behind it like digitalWrite, but at the cost of an OUT/SBI/CBI.
+class HostPort
+{
+public:
+    explicit HostPort(uint8_t firstPin) : m_firstPin(firstPin), m_value(0) {}
+
+    operator uint8_t() const { return m_value; }
+    HostPort& operator=(uint8_t value);
+    HostPort& operator|=(uint8_t bits);
+    HostPort& operator&=(uint8_t bits);
+
+private:
+    friend void digitalWrite(uint8_t pin, uint8_t val);
+
+    uint8_t m_firstPin;
+    uint8_t m_value;
+};
+
+// Port B is pins 8-13
+extern HostPort PORTB;
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+
+// Pin change interrupts. Only the PCINT0 bank (pins 8-13) is wired up; see
+// arduinoHostPinChange().
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCMSK0;
+
+#define PCIE0   0
+#define PCIF0   0
+#define PCINT0  0
+#define PCINT1  1
+#define PCINT2  2
+#define PCINT3  3
+#define PCINT4  4
+#define PCINT5  5
+
+#define ISR(vector) extern "C" void vector()
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    int availableForWrite();
+
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buffer, size_t size);
+
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+
+    size_t println();
+    size_t println(const char* s);
+
+private:
+    size_t printNumber(unsigned long n, int base);
+};
+
+extern HardwareSerial Serial;
+
+#endif // ARDUINO_H
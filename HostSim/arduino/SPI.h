@@ -0,0 +1,33 @@
+#ifndef SPI_H
+#define SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV16 0x01
+
+class SPIClass
+{
+public:
+    void begin();
+    void end();
+    void setDataMode(uint8_t mode);
+    void setBitOrder(uint8_t order);
+    void setClockDivider(uint8_t divider);
+    uint8_t transfer(uint8_t data);
+    void transfer(void* buf, size_t count);
+};
+
+extern SPIClass SPI;
+
+#endif // SPI_H
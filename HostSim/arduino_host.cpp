@@ -0,0 +1,369 @@
+#include "Arduino.h"
+#include "SPI.h"
+#include "arduino_host.h"
+
+#define NS_PER_US           1000ULL
+#define NS_PER_MS           1000000ULL
+
+// 16 MHz
+#define CYCLES(n)           ((uint64_t)(n) * 1000 / 16)
+
+#define DIGITAL_IO_NS       CYCLES(50)
+#define SPI_BYTE_NS         (2000 + CYCLES(8))
+// In SPI.transfer(buf, count) only the loop around each byte is on top of the wire time
+#define SPI_BURST_BYTE_NS   (2000 + CYCLES(3))
+#define PORT_WRITE_NS       CYCLES(2)
+#define SPI_BEGIN_NS        CYCLES(200)
+#define SERIAL_CALL_NS      CYCLES(40)
+#define SERIAL_TX_BUFFER    64
+// Interrupt entry and exit (push/pop, RETI)
+#define ISR_OVERHEAD_NS     CYCLES(40)
+
+// Pins 8-13 are PB0-PB5: PCINT0-5, PCINT0_vect
+#define PCINT0_FIRST_PIN    8
+#define PCINT0_LAST_PIN     13
+
+extern "C" void PCINT0_vect() __attribute__((weak));
+
+volatile uint8_t PCICR = 0;
+volatile uint8_t PCIFR = 0;
+volatile uint8_t PCMSK0 = 0;
+
+HardwareSerial Serial;
+SPIClass SPI;
+HostPort PORTB(8);
+
+static ArduinoHostBoard* g_board = 0;
+static FILE* g_serialOut = 0;
+static uint64_t g_now = 0;
+
+static bool g_interruptsEnabled = true;
+static bool g_inISR = false;
+
+static unsigned long g_serialBaudOverride = 0;
+static uint64_t g_serialByteTime = 0;
+static uint64_t g_serialDoneTime = 0;
+static uint32_t g_serialBytes = 0;
+
+static ArduinoHostIOStats g_ioStats;
+
+void arduinoHostAttach(ArduinoHostBoard* board, FILE* serialOut)
+{
+    g_board = board;
+    g_serialOut = serialOut;
+}
+
+uint64_t arduinoHostNow()
+{
+    return g_now;
+}
+
+void arduinoHostSetNow(uint64_t now)
+{
+    g_now = now;
+}
+
+void arduinoHostSetSerialBaud(unsigned long baud)
+{
+    g_serialBaudOverride = baud;
+}
+
+static void runPendingISRs()
+{
+    if (!g_interruptsEnabled || g_inISR || !(PCIFR & _BV(PCIF0)) || !PCINT0_vect)
+    {
+        return;
+    }
+
+    uint64_t start = g_now;
+    g_inISR = true;
+    PCIFR &= ~_BV(PCIF0);
+    g_now += ISR_OVERHEAD_NS;
+    PCINT0_vect();
+    g_inISR = false;
+    g_ioStats.isrTime += g_now - start;
+}
+
+void arduinoHostPinChange(uint8_t pin, uint64_t now)
+{
+    if (pin < PCINT0_FIRST_PIN || pin > PCINT0_LAST_PIN ||
+        !(PCICR & _BV(PCIE0)) || !(PCMSK0 & _BV(pin - PCINT0_FIRST_PIN)))
+    {
+        return;
+    }
+
+    PCIFR |= _BV(PCIF0);
+
+    // Preempt: run the ISR from 'now' and push back whatever the sketch was busy with
+    uint64_t busyUntil = g_now > now ? g_now : now;
+    g_now = now;
+    runPendingISRs();
+    g_now = busyUntil + (g_now - now);
+}
+
+uint32_t arduinoHostSerialBytes()
+{
+    return g_serialBytes;
+}
+
+const ArduinoHostIOStats& arduinoHostIOStats()
+{
+    return g_ioStats;
+}
+
+//------------------------------ Pins and time --------------------------------
+
+void pinMode(uint8_t /*pin*/, uint8_t /*mode*/)
+{
+    g_now += DIGITAL_IO_NS;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    g_now += DIGITAL_IO_NS;
+    g_ioStats.digitalIO++;
+    g_board->pinWrite(pin, val);
+
+    // digitalWrite goes through the same PORTx register
+    if (pin >= PORTB.m_firstPin && pin < PORTB.m_firstPin + 8)
+    {
+        uint8_t bit = _BV(pin - PORTB.m_firstPin);
+        PORTB.m_value = val ? (PORTB.m_value | bit) : (PORTB.m_value & ~bit);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    g_now += DIGITAL_IO_NS;
+    g_ioStats.digitalIO++;
+    return g_board->pinRead(pin);
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(g_now / NS_PER_MS);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(g_now / NS_PER_US);
+}
+
+void delay(unsigned long ms)
+{
+    g_now += ms * NS_PER_MS;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    g_now += us * NS_PER_US;
+}
+
+void interrupts()
+{
+    g_interruptsEnabled = true;
+    runPendingISRs();
+}
+
+void noInterrupts()
+{
+    g_interruptsEnabled = false;
+}
+
+//------------------------------ SPI ------------------------------------------
+
+void SPIClass::begin()
+{
+    g_now += SPI_BEGIN_NS;
+    g_ioStats.spiSetups++;
+}
+
+void SPIClass::end()
+{
+    g_now += CYCLES(10);
+    g_ioStats.spiSetups++;
+}
+
+void SPIClass::setDataMode(uint8_t /*mode*/)
+{
+}
+
+void SPIClass::setBitOrder(uint8_t /*order*/)
+{
+}
+
+void SPIClass::setClockDivider(uint8_t /*divider*/)
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    g_now += SPI_BYTE_NS;
+    g_ioStats.spiBytes++;
+    return g_board->spiTransfer(data);
+}
+
+void SPIClass::transfer(void* buf, size_t count)
+{
+    uint8_t* bytes = (uint8_t*)buf;
+    for (size_t i = 0; i < count; ++i)
+    {
+        g_now += SPI_BURST_BYTE_NS;
+        g_ioStats.spiBytes++;
+        bytes[i] = g_board->spiTransfer(bytes[i]);
+    }
+}
+
+//------------------------------ Ports ----------------------------------------
+
+HostPort& HostPort::operator=(uint8_t value)
+{
+    g_now += PORT_WRITE_NS;
+    g_ioStats.portWrites++;
+
+    uint8_t changed = m_value ^ value;
+    m_value = value;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+        if (changed & _BV(bit))
+        {
+            g_board->pinWrite(m_firstPin + bit, (value & _BV(bit)) ? HIGH : LOW);
+        }
+    }
+    return *this;
+}
+
+HostPort& HostPort::operator|=(uint8_t bits)
+{
+    return *this = m_value | bits;
+}
+
+HostPort& HostPort::operator&=(uint8_t bits)
+{
+    return *this = m_value & bits;
+}
+
+//------------------------------ Serial ---------------------------------------
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    if (g_serialBaudOverride)
+    {
+        baud = g_serialBaudOverride;
+    }
+
+    // 8N1: 10 bits per byte
+    g_serialByteTime = 10 * 1000000000ULL / baud;
+    g_serialDoneTime = g_now;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    uint64_t queued = g_serialDoneTime > g_now ? (g_serialDoneTime - g_now + g_serialByteTime - 1) / g_serialByteTime : 0;
+    return queued >= SERIAL_TX_BUFFER ? 0 : (int)(SERIAL_TX_BUFFER - queued);
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+    // Block until there is room in the TX buffer
+    if (g_serialDoneTime > g_now + SERIAL_TX_BUFFER * g_serialByteTime)
+    {
+        g_now = g_serialDoneTime - SERIAL_TX_BUFFER * g_serialByteTime;
+    }
+
+    g_serialDoneTime = (g_serialDoneTime > g_now ? g_serialDoneTime : g_now) + g_serialByteTime;
+    g_serialBytes++;
+
+    if (g_serialOut)
+    {
+        fputc(b, g_serialOut);
+    }
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    g_now += SERIAL_CALL_NS;
+    for (size_t i = 0; i < size; ++i)
+    {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+size_t HardwareSerial::print(const char* s)
+{
+    size_t n = 0;
+    g_now += SERIAL_CALL_NS;
+    while (*s)
+    {
+        n += write((uint8_t)*s++);
+    }
+    return n;
+}
+
+size_t HardwareSerial::print(char c)
+{
+    g_now += SERIAL_CALL_NS;
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::printNumber(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char* str = &buf[sizeof(buf) - 1];
+    *str = 0;
+
+    if (base < 2)
+    {
+        base = 10;
+    }
+
+    do
+    {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+
+    return print(str);
+}
+
+size_t HardwareSerial::print(unsigned char n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t HardwareSerial::print(int n, int base)
+{
+    return print((long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+    if (base == 10 && n < 0)
+    {
+        return print('-') + printNumber(-n, 10);
+    }
+    return printNumber((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t HardwareSerial::println()
+{
+    return print("\r\n");
+}
+
+size_t HardwareSerial::println(const char* s)
+{
+    return print(s) + println();
+}
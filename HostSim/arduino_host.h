@@ -0,0 +1,50 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+// Host side of the Arduino core in arduino/.
+//
+// The sketch runs on its own virtual clock (nanoseconds). Core calls advance it by
+// roughly what they cost on a 16 MHz ATmega328P: delay(), SPI bytes at SPI_CLOCK_DIV4,
+// digitalWrite/Read, and Serial writes that block once the 64-byte TX buffer is full
+// at the configured baud rate. Pins and SPI are routed to an ArduinoHostBoard.
+
+#include <stdint.h>
+#include <stdio.h>
+
+class ArduinoHostBoard
+{
+public:
+    virtual ~ArduinoHostBoard() {}
+    virtual void pinWrite(uint8_t pin, uint8_t value) = 0;
+    virtual int pinRead(uint8_t pin) = 0;
+    virtual uint8_t spiTransfer(uint8_t mosi) = 0;
+};
+
+void arduinoHostAttach(ArduinoHostBoard* board, FILE* serialOut);
+
+uint64_t arduinoHostNow();
+void arduinoHostSetNow(uint64_t now);
+
+// The sketch's pin change ISR, if it has one for this pin, runs at 'now'. If the sketch
+// is still busy with something else then, the ISR preempts it: it runs on its own
+// clock from 'now', and whatever it was busy with finishes that much later.
+void arduinoHostPinChange(uint8_t pin, uint64_t now);
+
+// Overrides the baud rate the sketch passes to Serial.begin(), if nonzero
+void arduinoHostSetSerialBaud(unsigned long baud);
+
+uint32_t arduinoHostSerialBytes();
+
+// I/O the sketch has done, for comparing ways of driving the radio
+struct ArduinoHostIOStats
+{
+    uint32_t spiSetups;     // SPI.begin() and SPI.end(): SPCR and pin direction setup
+    uint32_t spiBytes;
+    uint32_t digitalIO;     // digitalWrite() and digitalRead()
+    uint32_t portWrites;    // direct port register writes
+    uint64_t isrTime;       // in interrupt handlers, in nanoseconds
+};
+
+const ArduinoHostIOStats& arduinoHostIOStats();
+
+#endif // ARDUINO_HOST_H
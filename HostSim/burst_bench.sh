@@ -0,0 +1,58 @@
+#!/bin/sh
+# Burst benchmark: builds the host simulation from the working tree and runs a usage
+# profile at several packet loss rates, once on an ACKed link profile and once on
+# LINK_PROFILE_BURST (see link_profile.h), with the controller's DIP switches and the
+# receiver's jumpers set to match. Prints how often the controller's MCU woke up, its
+# time on air, the button edge to air latency, the edges the receiver never heard of and
+# the average current for each.
+#
+#   HostSim/burst_bench.sh [profile]
+#
+# The profile defaults to profiles/gameplay.txt. Pass other rates with
+# LOSSES="0.05 0.5", and the ACKed link profile to compare with as ACK_PROFILE=0
+# (1 by default, which has the burst profile's air rate and CRC).
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+profile=${1:-"$here/profiles/gameplay.txt"}
+losses=${LOSSES:-"0 0.1 0.3"}
+ack=${ACK_PROFILE:-1}
+burst=3
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# build <output binary>, with the Makefile
+build()
+{
+    obj=$(mktemp -d "$work/obj.XXXXXX")
+    make -s -C "$here" OUT="$obj" WARNINGS=
+    cp "$obj/segagen-host" "$1"
+}
+
+# run <link profile> <loss> <label>: one row of the table. The profile goes in DIP
+# switches 2 and 3; unit 0.
+run()
+{
+    { printf "dip %x\nrxprofile %s\nloss %s\n" $(($1 << 2)) "$1" "$2"; cat "$profile"; } |
+        "$work/host" | awk -v loss="$2" -v label="$3" '
+        /^wakeups from LPM3:/ { wakeups = $4 }
+        /^radio packets:/ { air = $9 }
+        /^edge to air:/ { mean = $7; max = $10 }
+        /^edges lost:/ { lost = $3 }
+        /^average current:/ { current = $3 }
+        END {
+            printf "%-6s %-10s %8s %12s %14s %12s %5s %9s\n", loss, label, wakeups, air, mean, max,
+                   lost == "" ? "-" : lost, current
+        }'
+}
+
+build "$work/host"
+
+printf "%-6s %-10s %8s %12s %14s %12s %5s %9s\n" "loss" "mode" "wakeups" "on air us" "edge to air us" "max us" "lost" "mA"
+for loss in $losses
+do
+    run "$ack" "$loss" "ACK $ack"
+    run "$burst" "$loss" "burst $burst"
+done
@@ -0,0 +1,104 @@
+#!/bin/sh
+# Host simulation checks: runs scripted scenarios on the host simulation and compares
+# its report with what each feature promises. Prints one line per check and exits with
+# status 1 if any of them fails.
+#
+#   make -C HostSim check           builds the simulation and runs these
+#   HostSim/check.sh [build dir]    with segagen-host and rxdump already built there
+
+here=$(cd "$(dirname "$0")" && pwd)
+build=${1:-"$here/build"}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+
+# run <script line>...: the report for a script made of these lines, in $work/report,
+# and what the receiver sent the PC, in $work/serial
+run()
+{
+    printf '%s\n' "$@" | HOST_RX_SERIAL="$work/serial" "$build/segagen-host" >"$work/report"
+}
+
+# field <label> <n>: field n of the report line that starts with the label, as a number
+field()
+{
+    awk -v label="$1" -v n="$2" 'index($0, label) == 1 { value = $n } END { printf "%.10g\n", value + 0 }' "$work/report"
+}
+
+# expect <check> <value> <operator> <limit>
+expect()
+{
+    if awk -v value="$2" -v limit="$4" "BEGIN { exit !(value $3 limit) }"
+    then
+        printf "ok    %s (%s)\n" "$1" "$2"
+    else
+        printf "FAIL  %s: %s, expected %s %s\n" "$1" "$2" "$3" "$4"
+        failed=1
+    fi
+}
+
+# edges: a button change every 20 ms, 400 of them: far enough apart for the key poll to
+# see every one
+edges()
+{
+    awk 'BEGIN { for (i = 0; i < 400; ++i) printf "%d %02x\n", 1000000 + i * 20000, i % 2 ? 0 : 2 ^ (int(i / 2) % 8) }'
+}
+
+# Radio register shadow (radio.c): a wake from power-down only checks RF_CH and sets
+# PWR_UP, however many times the controller goes to sleep
+run "$(cat "$here/profiles/pauses.txt")"
+expect "wakes from power-down" "$(field "radio wakes:" 3)" ">=" 10
+expect "SPI transactions per wake" "$(field "radio wakes:" 15)" "<=" 2
+
+# Sleep tiers (sleep.c): one press, five seconds awake before sleep mode (awake.c), then
+# SLEEP_STANDBY_MILLIS in standby before the radio powers down for the rest of the run
+run "1000000 01" "1100000 00" "end 30000000"
+expect "radio standby-I us before powering down" "$(field "radio time:" 19)" "<" 9000000
+
+# Interrupt-driven receive (ArduinoRX drainRadio()): a button mash with the serial port
+# at 1200 baud, far behind it, still never fills the radio's RX FIFO
+run "serial 1200" "presses 1000000 11000000 40 10000 ff 3"
+expect "RX FIFO full drops at 1200 baud" "$(field "receiver:" 4)" "==" 0
+expect "MAX_RT at 1200 baud" "$(field "radio packets:" 7)" "==" 0
+
+# Auto-retransmit (link profile ARC): with 10% of packets and ACKs lost, the radio's own
+# retries get every change through without a MAX_RT, so the MCU wakes no more often
+run "$(edges)"
+expect "edges lost without loss" "$(field "edges lost:" 3)" "==" 0
+wakeups=$(awk -v n="$(field "wakeups from LPM3:" 4)" 'BEGIN { print int(n * 1.05) }')
+run "loss 0.1" "$(edges)"
+expect "edges lost at 10% loss" "$(field "edges lost:" 3)" "==" 0
+expect "MAX_RT at 10% loss" "$(field "radio packets:" 7)" "==" 0
+expect "wakeups at 10% loss" "$(field "wakeups from LPM3:" 4)" "<=" "$wakeups"
+
+# Channel hopping (link.h): Wi-Fi on the first channel moves the controller and the
+# receiver to another one together. With the hop confirm's ACKs lost, the controller
+# goes on the confirm's MAX_RT: that one MAX_RT more, and no scan.
+run "interferer 1 23 0.5" "$(edges)"
+expect "hop away from a busy channel" "$(field "radio channel:" 4)" "!=" 3
+expect "receiver hops too" "$(field "radio channel:" 6)" "==" "$(field "radio channel:" 4)"
+maxrt=$(($(field "radio packets:" 7) + 1))
+run "interferer 1 23 0.5" "hopackloss 3" "$(edges)"
+expect "receiver hops with the confirm's ACKs lost" "$(field "radio channel:" 6)" "==" "$(field "radio channel:" 4)"
+expect "MAX_RT with the confirm's ACKs lost" "$(field "radio packets:" 7)" "<=" "$maxrt"
+expect "edges lost with the confirm's ACKs lost" "$(field "edges lost:" 3)" "==" 0
+
+# Burst profile (link_profile.h): the receiver gets each state as several NOACK copies,
+# and passes it on once
+run "dip c" "rxprofile 3" "loss 0.1" "$(edges)"
+"$build/rxdump" <"$work/serial" 2>/dev/null | awk '
+    match($0, / state seq +[0-9]+/) {
+        states++
+        seq = substr($0, RSTART + 10, RLENGTH - 10) + 0
+        if (states > 1 && seq == last) repeats++
+        last = seq
+    }
+    END { print states + 0, repeats + 0 }' >"$work/states"
+read states repeats <"$work/states"
+copies=$(awk -v packets="$(field "receiver:" 2)" -v states="$states" 'BEGIN { printf "%.1f", packets / (states ? states : 1) }')
+expect "burst copies received per state" "$copies" ">=" 2
+expect "burst states passed on twice" "$repeats" "==" 0
+
+exit $failed
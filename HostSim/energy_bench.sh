@@ -0,0 +1,47 @@
+#!/bin/sh
+# Battery benchmark: runs the usage profiles in profiles/ on the host simulation, built
+# from a git revision (HEAD by default) and from the working tree, and prints the
+# controller's average current (mAh per hour) for each.
+#
+#   HostSim/energy_bench.sh [revision]
+#
+# Any profile script works; pass more with PROFILES="a.txt b.txt".
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/.." && pwd)
+rev=${1:-HEAD}
+profiles=${PROFILES:-"$here/profiles/idle.txt $here/profiles/menu.txt $here/profiles/gameplay.txt"}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# build <source tree> <output binary>, with the Makefile
+build()
+{
+    obj=$(mktemp -d "$work/obj.XXXXXX")
+    make -s -C "$here" SRC="$1" OUT="$obj" WARNINGS=
+    cp "$obj/segagen-host" "$2"
+}
+
+# mAh per hour from a run's report, or "-" if that version has no energy report
+current()
+{
+    "$1" < "$2" | awk '/^average current:/ { print $3; found = 1 } END { if (!found) print "-" }'
+}
+
+mkdir "$work/base"
+(cd "$root" && git archive "$rev") | tar -x -C "$work/base"
+build "$work/base" "$work/before"
+build "$root" "$work/after"
+
+printf "%-16s %14s %14s %9s\n" "profile" "$rev" "working tree" "change"
+for profile in $profiles
+do
+    before=$(current "$work/before" "$profile")
+    after=$(current "$work/after" "$profile")
+    change=$(awk -v b="$before" -v a="$after" \
+        'BEGIN { if (b == "-" || a == "-" || b == 0) print "-"; else printf "%+.1f%%", 100 * (a - b) / b }')
+    printf "%-16s %14s %14s %9s\n" "$(basename "$profile" .txt)" "$before" "$after" "$change"
+done
@@ -0,0 +1,993 @@
+#include "hal.h"
+#include "sim_world.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// All times are in nanoseconds of virtual time.
+#define NS_PER_US               1000ULL
+#define NS_PER_MS               1000000ULL
+#define NS_PER_S                1000000000ULL
+
+// MCLK is 8 MHz, ACLK is the ~12 kHz VLO
+#define MCLK_CYCLE_NS           125ULL
+#define ACLK_HZ                 12000ULL
+
+// SPI is MCLK/2 = 4 MHz, so 2 us (16 MCLK) on the wire per byte.
+// halSpiTransfer adds the spin loop around it, costed as before the burst paths existed.
+// Write bursts are wire-bound.
+#define SPI_BYTE_NS             2000ULL
+#define SPI_TRANSFER_OVERHEAD_NS (12 * MCLK_CYCLE_NS)
+#define SPI_BURST_OVERHEAD_NS   (20 * MCLK_CYCLE_NS)
+
+// Interrupt entry + RETI: 6 and 5 cycles (MSP430x2xx family user's guide)
+#define ISR_OVERHEAD_NS         (11 * MCLK_CYCLE_NS)
+
+// Key poll ISR bodies, besides any delay: the poll turns the pull-ups on, the sample
+// (CCR2, through TA0IV) reads them. Counted by hand from hal.c, not measured.
+#define KEY_POLL_ISR_NS         (32 * MCLK_CYCLE_NS)
+#define KEY_SAMPLE_ISR_NS       (28 * MCLK_CYCLE_NS)
+
+// A P2 pin pulled down between polls reads low (pressed) until its pull-up charges it
+#define KEY_CHARGE_NS           (2 * NS_PER_US)
+
+#define MAX_SCRIPT_EVENTS       16384
+#define MAX_SCRIPT_PRESSES      4096
+
+// Interrupt source (written to by ISRs to wake up main thread)
+#define INT_SRC_BUTTON_CHANGE   0x1
+#define INT_SRC_TIMER           0x2
+#define INT_SRC_RADIO_IRQ       0x4
+
+#define LPM3_EXIT               (g_lpmExit = 1)
+#define LPM4_EXIT               (g_lpmExit = 1)
+
+typedef struct
+{
+    uint64_t time;
+    uint8_t buttons;
+} ScriptEvent;
+
+// A generated press of one button ("presses" script lines)
+typedef struct
+{
+    uint64_t start;
+    uint64_t end;
+    uint8_t button;
+} ScriptPress;
+
+static volatile uint8_t g_interruptSource = 0;
+
+// Timer configuration
+// TIMER0_A runs continuously off ACLK. CCR0 paces the key polls, CCR1 is the deadline,
+// CCR2 samples the keys once the pull-ups have charged the pins.
+static uint16_t g_keyPollTicks = 0;
+static HalTime g_deadline = 0;
+
+// Set by halSetKeyWake(): no key polls, P2 edges wake us instead
+static uint8_t g_keyWake = 0;
+
+// Key change detection
+static volatile uint8_t g_lastButtons = 0;
+static volatile HalTime g_lastButtonsTime = 0;
+static uint8_t g_lastButtonsCapture = 0;
+static HalTime g_lastButtonsTimeCapture = 0;
+
+// Callbacks to higher layer
+static EventHandler g_deadlineCB = 0;
+static EventHandler g_radioIRQCB = 0;
+static EventHandler g_buttonsCB = 0;
+
+// Virtual CPU
+static uint64_t g_now = 0;
+static uint64_t g_endTime = 0;
+static int g_gie = 0;
+static int g_lpmExit = 0;
+
+// Virtual TIMER0_A, counted in ACLK ticks since power-up (64 bits, so it never wraps).
+// Each compare is the tick it matches at; CCIE off is modeled as not armed.
+static int g_keyPollArmed = 0;
+static uint64_t g_keyPollCompare = 0;
+static int g_keyPollIFG = 0;
+static int g_deadlineArmed = 0;
+static uint64_t g_deadlineCompare = 0;
+static int g_deadlineIFG = 0;
+static int g_keySampleArmed = 0;
+static uint64_t g_keySampleCompare = 0;
+static int g_keySampleIFG = 0;
+static int g_keyConfirm = 0;        // the sample saw a change; look again next tick
+
+// When the P2 pull-ups went on (they're off between polls)
+static uint64_t g_pullupStart = 0;
+
+// When hostLatchEvents() last looked at the compares
+static uint64_t g_lastLatchTime = 0;
+
+// Time spent in LPM4, where ACLK (and so TIMER0_A) stands still
+static uint64_t g_aclkStoppedTime = 0;
+
+// Virtual PORT1 IRQ flag (radio IRQ line, falling edge)
+static int g_port1IFG = 0;
+
+// Virtual PORT2 (buttons): P2IE, and P2IFG for the pins pressed while it was on
+static uint8_t g_port2IE = 0;
+static uint8_t g_port2IFG = 0;
+
+// Button script (pressed-button mask over time)
+static ScriptEvent g_script[MAX_SCRIPT_EVENTS];
+static int g_scriptLength = 0;
+static int g_scriptPos = 0;
+static uint8_t g_pressedButtons = 0;
+static uint8_t g_dip = 0;
+static ScriptPress g_presses[MAX_SCRIPT_PRESSES];
+static int g_pressCount = 0;
+
+// Level of the radio IRQ line last time we looked (1 = asserted/low)
+static int g_radioIRQLevel = 0;
+
+// Statistics
+static int g_trace = 0;
+static uint64_t g_sleepTime = 0;
+static uint64_t g_lpm4Time = 0;
+static uint32_t g_wakeups = 0;
+static uint32_t g_keyWakes = 0;
+static uint32_t g_interrupts = 0;
+static uint32_t g_spiTransactions = 0;
+static uint32_t g_spiBytes = 0;
+static uint64_t g_spiTime = 0;
+static uint32_t g_keyPolls = 0;
+static uint64_t g_keyPollIsrTime = 0;
+static uint64_t g_pullupTime = 0;
+static uint64_t g_pullupButtonTime = 0;
+
+static void hostTrace(const char* fmt, ...)
+{
+    if (!g_trace)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%12.3f us: ", (double)g_now / NS_PER_US);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// xorshift32: the same presses from the same seed on any host
+static uint32_t hostRandom(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Uniform in [0, range]
+static uint64_t hostRandomNs(uint32_t* state, uint64_t range)
+{
+    return (uint64_t)(hostRandom(state) / 4294967296.0 * (range + 1));
+}
+
+// One button of 'mask' at a time, held for 'hold' give or take half, from 'from' to 'to'.
+// The gaps between presses are random, 'perSecond' presses a second on average.
+static void hostGeneratePresses(uint64_t from, uint64_t to, double perSecond, uint64_t hold,
+                                uint8_t mask, uint32_t seed)
+{
+    uint8_t buttons[8];
+    int count = 0;
+    for (int bit = 0; bit < 8; ++bit)
+    {
+        if (mask & (1 << bit))
+        {
+            buttons[count++] = (uint8_t)(1 << bit);
+        }
+    }
+
+    if (!count || perSecond <= 0)
+    {
+        return;
+    }
+
+    uint64_t period = (uint64_t)(NS_PER_S / perSecond);
+    uint64_t gap = period > hold ? period - hold : 0;
+    uint32_t rng = seed ? seed : 1;
+    uint64_t time = from;
+
+    while (g_pressCount < MAX_SCRIPT_PRESSES)
+    {
+        time += hostRandomNs(&rng, 2 * gap);
+        uint64_t held = hold / 2 + hostRandomNs(&rng, hold);
+        if (time + held > to)
+        {
+            break;
+        }
+
+        ScriptPress* press = &g_presses[g_pressCount++];
+        press->start = time;
+        press->end = time + held;
+        press->button = buttons[hostRandom(&rng) % count];
+        time += held;
+    }
+}
+
+static int compareTimes(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Rewrite the script with the generated presses held down on top of the scripted mask
+static void hostMergePresses()
+{
+    static ScriptEvent scripted[MAX_SCRIPT_EVENTS];
+    static uint64_t times[MAX_SCRIPT_EVENTS + 2 * MAX_SCRIPT_PRESSES];
+    int scriptedLength = g_scriptLength;
+    int timeCount = 0;
+
+    memcpy(scripted, g_script, sizeof(ScriptEvent) * scriptedLength);
+    for (int i = 0; i < scriptedLength; ++i)
+    {
+        times[timeCount++] = scripted[i].time;
+    }
+    for (int i = 0; i < g_pressCount; ++i)
+    {
+        times[timeCount++] = g_presses[i].start;
+        times[timeCount++] = g_presses[i].end;
+    }
+    qsort(times, timeCount, sizeof(times[0]), compareTimes);
+
+    uint8_t last = 0;
+    int next = 0;
+    uint8_t scriptedButtons = 0;
+    g_scriptLength = 0;
+
+    for (int i = 0; i < timeCount && g_scriptLength < MAX_SCRIPT_EVENTS; ++i)
+    {
+        uint64_t time = times[i];
+        if (i > 0 && time == times[i - 1])
+        {
+            continue;
+        }
+
+        while (next < scriptedLength && scripted[next].time <= time)
+        {
+            scriptedButtons = scripted[next++].buttons;
+        }
+
+        uint8_t buttons = scriptedButtons;
+        for (int p = 0; p < g_pressCount; ++p)
+        {
+            if (g_presses[p].start <= time && time < g_presses[p].end)
+            {
+                buttons |= g_presses[p].button;
+            }
+        }
+
+        if (buttons != last)
+        {
+            g_script[g_scriptLength].time = time;
+            g_script[g_scriptLength].buttons = buttons;
+            g_scriptLength++;
+            last = buttons;
+        }
+    }
+}
+
+static void hostReadScript(FILE* f)
+{
+    char line[128];
+    uint64_t lastTime = 0;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char* comment = strchr(line, '#');
+        if (comment)
+        {
+            *comment = 0;
+        }
+
+        unsigned long long usec;
+        unsigned int value;
+        unsigned long long to, hold;
+        double perSecond;
+        unsigned int seed = 1;
+
+        if (sscanf(line, " end %llu", &usec) == 1)
+        {
+            g_endTime = usec * NS_PER_US;
+        }
+        else if (sscanf(line, " dip %x", &value) == 1)
+        {
+            g_dip = (uint8_t)value;
+        }
+        else if (sscanf(line, " presses %llu %llu %lf %llu %x %u", &usec, &to, &perSecond, &hold,
+                        &value, &seed) >= 5)
+        {
+            hostGeneratePresses(usec * NS_PER_US, to * NS_PER_US, perSecond, hold * NS_PER_US,
+                                (uint8_t)value, seed);
+            if (to * NS_PER_US > lastTime)
+            {
+                lastTime = to * NS_PER_US;
+            }
+        }
+        else if (hostWorldConfigure(line))
+        {
+        }
+        else if (sscanf(line, " %llu %x", &usec, &value) == 2 && g_scriptLength < MAX_SCRIPT_EVENTS)
+        {
+            ScriptEvent* ev = &g_script[g_scriptLength++];
+            ev->time = usec * NS_PER_US;
+            ev->buttons = (uint8_t)value;
+            if (ev->time > lastTime)
+            {
+                lastTime = ev->time;
+            }
+        }
+    }
+
+    if (g_pressCount)
+    {
+        hostMergePresses();
+    }
+
+    if (!g_endTime)
+    {
+        g_endTime = lastTime + 10 * NS_PER_S;
+    }
+}
+
+// Apply scripted button edges up to the current time
+static void hostUpdateButtons()
+{
+    while (g_scriptPos < g_scriptLength && g_script[g_scriptPos].time <= g_now)
+    {
+        ScriptEvent* ev = &g_script[g_scriptPos++];
+        if (ev->buttons != g_pressedButtons)
+        {
+            int wake = (ev->buttons & ~g_pressedButtons & g_port2IE) != 0;
+            g_pressedButtons = ev->buttons;
+            hostWorldButtonEdge(ev->time, ev->buttons, wake);
+        }
+    }
+}
+
+//------------------------------ Virtual timeline -----------------------------
+
+static uint64_t hostTicks()
+{
+    return (g_now - g_aclkStoppedTime) * ACLK_HZ / NS_PER_S;
+}
+
+// Time the counter reaches 'ticks', if ACLK doesn't stop again before then
+static uint64_t hostTickTime(uint64_t ticks)
+{
+    return (ticks * NS_PER_S + ACLK_HZ - 1) / ACLK_HZ + g_aclkStoppedTime;
+}
+
+// A compare matches once, as the counter reaches it. It's ahead until then; after
+// that the ISR moves it on, but may be busy for a while before it does.
+static int hostCompareAhead(uint64_t compare)
+{
+    return hostTickTime(compare) > g_lastLatchTime;
+}
+
+static int hostCompareMatched(uint64_t compare, uint64_t since)
+{
+    uint64_t time = hostTickTime(compare);
+    return time > since && time <= g_now;
+}
+
+static uint64_t hostNextEventTime()
+{
+    uint64_t next = UINT64_MAX;
+
+    if (g_keyPollArmed && hostCompareAhead(g_keyPollCompare) && hostTickTime(g_keyPollCompare) < next)
+    {
+        next = hostTickTime(g_keyPollCompare);
+    }
+
+    if (g_deadlineArmed && hostCompareAhead(g_deadlineCompare) && hostTickTime(g_deadlineCompare) < next)
+    {
+        next = hostTickTime(g_deadlineCompare);
+    }
+
+    if (g_keySampleArmed && hostCompareAhead(g_keySampleCompare) && hostTickTime(g_keySampleCompare) < next)
+    {
+        next = hostTickTime(g_keySampleCompare);
+    }
+
+    // Button edges only interrupt while we wait for them; otherwise the polls see them
+    if (g_port2IE && g_scriptPos < g_scriptLength && g_script[g_scriptPos].time < next)
+    {
+        next = g_script[g_scriptPos].time;
+    }
+
+    uint64_t worldNext = hostWorldNextEventTime();
+    if (worldNext < next)
+    {
+        next = worldNext;
+    }
+
+    return next;
+}
+
+// Raise interrupt flags for everything that has come due
+static void hostLatchEvents()
+{
+    hostUpdateButtons();
+
+    // Compares that matched since we last looked
+    uint64_t since = g_lastLatchTime;
+    g_lastLatchTime = g_now;
+
+    if (g_keyPollArmed && hostCompareMatched(g_keyPollCompare, since))
+    {
+        g_keyPollIFG = 1;
+    }
+
+    if (g_deadlineArmed && hostCompareMatched(g_deadlineCompare, since))
+    {
+        g_deadlineIFG = 1;
+    }
+
+    if (g_keySampleArmed && hostCompareMatched(g_keySampleCompare, since))
+    {
+        g_keySampleIFG = 1;
+    }
+
+    hostWorldAdvance(g_now);
+
+    // P1.0 interrupts on the falling edge of the radio IRQ line
+    int irq = hostRadioIRQ();
+    if (irq && !g_radioIRQLevel)
+    {
+        hostTrace("radio: IRQ");
+        g_port1IFG = 1;
+    }
+    g_radioIRQLevel = irq;
+
+    // P2 interrupts on the falling edge of a button pulled up, i.e. when it's pressed
+    g_port2IFG |= g_pressedButtons & g_port2IE;
+}
+
+static void timer0Isr();
+static void timer1Isr();
+static void keySampleIsr();
+static void port1Isr();
+static void port2Isr();
+
+static void hostRunPendingIsrs()
+{
+    while (g_gie && (g_keyPollIFG || g_deadlineIFG || g_keySampleIFG || g_port2IFG || g_port1IFG))
+    {
+        // GIE is cleared on interrupt entry and restored by RETI.
+        // TIMER0_A0 > TIMER0_A1 (CCR1, then CCR2) > PORT2 > PORT1 in priority.
+        g_gie = 0;
+        g_interrupts++;
+        g_now += ISR_OVERHEAD_NS;
+        if (g_keyPollIFG)
+        {
+            uint64_t start = g_now - ISR_OVERHEAD_NS;
+            g_keyPollIFG = 0;
+            timer0Isr();
+            g_keyPollIsrTime += g_now - start;
+        }
+        else if (g_deadlineIFG)
+        {
+            g_deadlineIFG = 0;
+            timer1Isr();
+        }
+        else if (g_keySampleIFG)
+        {
+            uint64_t start = g_now - ISR_OVERHEAD_NS;
+            g_keySampleIFG = 0;
+            keySampleIsr();
+            g_keyPollIsrTime += g_now - start;
+        }
+        else if (g_port2IFG)
+        {
+            port2Isr();
+        }
+        else
+        {
+            g_port1IFG = 0;
+            port1Isr();
+        }
+        g_gie = 1;
+        hostLatchEvents();
+    }
+}
+
+// CPU is busy for the given time. Interrupts are taken as they come due.
+static void hostBusy(uint64_t duration)
+{
+    uint64_t end = g_now + duration;
+
+    for (;;)
+    {
+        uint64_t next = hostNextEventTime();
+        if (next > end)
+        {
+            break;
+        }
+
+        if (next > g_now)
+        {
+            g_now = next;
+        }
+        hostLatchEvents();
+
+        if (g_gie)
+        {
+            uint64_t before = g_now;
+            hostRunPendingIsrs();
+            end += g_now - before;
+        }
+    }
+
+    g_now = end;
+    hostLatchEvents();
+}
+
+static void hostEnableInterrupts()
+{
+    g_gie = 1;
+    hostRunPendingIsrs();
+}
+
+// Sleep on to 'time'. ACLK, and TIMER0_A with it, stands still in LPM4.
+static void hostSleepUntil(uint64_t time, int lpm4)
+{
+    g_sleepTime += time - g_now;
+    if (lpm4)
+    {
+        g_lpm4Time += time - g_now;
+        g_aclkStoppedTime += time - g_now;
+    }
+    g_now = time;
+}
+
+// LPM3 until an ISR exits low-power mode, or LPM4 when halMain would pick it. Returns 0
+// when the simulation is over.
+static int hostSleep()
+{
+    g_lpmExit = 0;
+    g_gie = 1;
+    hostRunPendingIsrs();
+
+    int lpm4 = g_keyWake && !g_deadlineArmed;
+
+    while (!g_lpmExit)
+    {
+        uint64_t next = hostNextEventTime();
+        if (next >= g_endTime)
+        {
+            hostSleepUntil(g_endTime, lpm4);
+            return 0;
+        }
+
+        hostSleepUntil(next, lpm4);
+        hostLatchEvents();
+        hostRunPendingIsrs();
+    }
+
+    g_wakeups++;
+    return 1;
+}
+
+static void hostReport()
+{
+    double total = (double)g_now / NS_PER_MS;
+    double active = (double)(g_now - g_sleepTime) / NS_PER_MS;
+
+    hostLatchEvents();
+
+    printf("sim time:          %.3f ms\n", total);
+    printf("cpu active:        %.3f ms (%.3f%%)\n", active, total > 0 ? 100.0 * active / total : 0.0);
+    printf("wakeups from LPM3: %lu\n", (unsigned long)g_wakeups);
+    printf("LPM4:              %.3f ms, woken by %lu key presses\n", (double)g_lpm4Time / NS_PER_MS,
+           (unsigned long)g_keyWakes);
+    printf("interrupts:        %lu\n", (unsigned long)g_interrupts);
+    printf("spi transactions:  %lu (%lu bytes, %.1f us)\n", (unsigned long)g_spiTransactions,
+           (unsigned long)g_spiBytes, (double)g_spiTime / NS_PER_US);
+
+    // Cycles from both halves of each poll, entry and RETI included, as estimated above
+    if (g_keyPolls)
+    {
+        printf("key polls:         %lu, %.1f cycles in ISRs (estimated) and %.1f us with pull-ups on, each\n",
+               (unsigned long)g_keyPolls, (double)g_keyPollIsrTime / MCLK_CYCLE_NS / g_keyPolls,
+               (double)g_pullupTime / NS_PER_US / g_keyPolls);
+    }
+
+    HostCpuTime cpu;
+    cpu.total = g_now;
+    cpu.active = g_now - g_sleepTime;
+    cpu.lpm4 = g_lpm4Time;
+    cpu.spi = g_spiTime;
+    cpu.pullupButtons = g_pullupButtonTime;
+    hostWorldReport(&cpu);
+}
+
+//------------------------------ hal_host.h -----------------------------------
+
+void halHostSpiBegin()
+{
+    g_spiTransactions++;
+    hostLatchEvents();
+    hostRadioSetCSN(0);
+}
+
+void halHostSpiEnd()
+{
+    hostRadioSetCSN(1);
+    hostLatchEvents();
+}
+
+void halHostDelayMicroseconds(uint32_t usec)
+{
+    hostBusy(usec * NS_PER_US);
+}
+
+uint16_t halHostDisableInterrupts()
+{
+    uint16_t oldSR = g_gie ? BIT3 : 0;
+    g_gie = 0;
+    return oldSR;
+}
+
+void halHostRestoreInterrupts(uint16_t oldSR)
+{
+    if (oldSR & BIT3)
+    {
+        hostEnableInterrupts();
+    }
+}
+
+void halHostSetLed(int on)
+{
+    hostTrace("led %s", on ? "on" : "off");
+}
+
+uint64_t halHostSpiNanoseconds()
+{
+    return g_spiTime;
+}
+
+//------------------------------ hal.h ----------------------------------------
+//
+// hal.c only builds for the MSP430, so what follows copies its logic by hand onto the
+// virtual peripherals above. A change to any of these in hal.c needs the same change
+// here:
+//
+//   hal.c                                  hal_host.c
+//   PORT1_HOOK (radio IRQ)                 port1Isr
+//   PORT2_HOOK (key wake)                  port2Isr
+//   TIMER0_A0_ISR_HOOK (CCR0, key poll)    timer0Isr
+//   TIMER0_A1_ISR_HOOK, CCR1 (deadline)    timer1Isr
+//   TIMER0_A1_ISR_HOOK, CCR2 (key sample)  keySampleIsr, armKeySample() inlined
+//   halSetKeyPollInterval, halSetKeyWake, halSetDeadline, halClearDeadline,
+//   halReadDIP, halSetRadioCE, halMain     the same
+//
+// Modelled rather than copied: the clock, GPIO, SPI and timer set-up (hal.c's *Init()),
+// readTimer() (hostTicks()), and halSpiTransfer/halSpiWriteBurst, which cost the
+// constants at the top of this file and hand each byte to the radio model. Those
+// constants and the ISR costs are cycle estimates, not measurements.
+
+static void port1Isr()
+{
+    g_interruptSource |= INT_SRC_RADIO_IRQ;
+    LPM3_EXIT;
+}
+
+static void port2Isr()
+{
+    // A button went down while we waited for one (halSetKeyWake)
+    uint8_t watched = g_port2IE;
+    uint8_t buttons = (g_lastButtons & ~watched) | ((g_pressedButtons | g_port2IFG) & watched);
+
+    // Back to pull-downs until the polls take over again
+    g_port2IE = 0;
+    g_port2IFG = 0;
+    g_keyWake = 0;
+    g_keyWakes++;
+
+    hostTrace("buttons %02x (P2 edge)", buttons);
+    g_lastButtons = buttons;
+    g_lastButtonsTime = halNow();
+    g_interruptSource |= INT_SRC_BUTTON_CHANGE;
+    LPM4_EXIT;
+}
+
+uint8_t halReadButtons()
+{
+    return g_lastButtonsCapture;
+}
+
+HalTime halReadButtonsTime()
+{
+    return g_lastButtonsTimeCapture;
+}
+
+uint8_t halReadDIP()
+{
+    halDelayMicroseconds(2);
+
+    // The board has four switches: anything above them reads as off
+    return g_dip & 0x0F;
+}
+
+uint16_t halReadBatteryVoltage()
+{
+    return 4200;
+}
+
+void halSetRadioCE(int high)
+{
+    hostTrace("radio: CE %s", high ? "high" : "low");
+    hostLatchEvents();
+    hostRadioSetCE(high);
+}
+
+HalTime halNow()
+{
+    return (HalTime)hostTicks();
+}
+
+void halSetKeyPollInterval(int keyPollInterval)
+{
+    halBeginNoInterrupts();
+
+    g_port2IE = 0;
+    g_port2IFG = 0;
+    g_keyWake = 0;
+
+    g_keyPollTicks = keyPollInterval * HAL_TICKS_PER_MILLI;
+    g_keyPollCompare = hostTicks() + g_keyPollTicks;
+    g_keyPollArmed = 1;
+    g_keyPollIFG = 0;
+
+    halEndNoInterrupts();
+}
+
+void halSetKeyWake()
+{
+    halBeginNoInterrupts();
+
+    g_keyPollArmed = 0;
+    g_keyPollIFG = 0;
+    g_keySampleArmed = 0;
+    g_keySampleIFG = 0;
+    g_keyConfirm = 0;
+
+    // The buttons that are up get their pull-ups and P2IE; a press while they charge is
+    // flagged by hand, as in hal.c
+    uint8_t up = ~g_lastButtons;
+    halDelayMicroseconds(6);
+    hostUpdateButtons();
+    g_port2IFG = g_pressedButtons & up;
+    g_port2IE = up;
+    g_keyWake = 1;
+
+    halEndNoInterrupts();
+}
+
+void halSetDeadline(HalTime time)
+{
+    halBeginNoInterrupts();
+
+    uint64_t now = hostTicks();
+    g_deadline = time;
+    g_deadlineCompare = now + (int32_t)(time - (HalTime)now);
+    g_deadlineArmed = 1;
+    g_deadlineIFG = 0;
+
+    if ((int32_t)(halNow() - time) >= 0)
+    {
+        g_deadlineArmed = 0;
+        g_interruptSource |= INT_SRC_TIMER;
+    }
+
+    halEndNoInterrupts();
+}
+
+void halClearDeadline()
+{
+    g_deadlineArmed = 0;
+    g_deadlineIFG = 0;
+}
+
+static void hostSpiBusy(uint64_t duration)
+{
+    g_spiTime += duration;
+    hostBusy(duration);
+}
+
+uint8_t halSpiTransfer(uint8_t data)
+{
+    g_spiBytes++;
+    hostSpiBusy(SPI_BYTE_NS + SPI_TRANSFER_OVERHEAD_NS);
+    return hostRadioSpiTransfer(data);
+}
+
+void halSpiWriteBurst(const uint8_t* src, int size)
+{
+    if (size <= 0)
+    {
+        return;
+    }
+
+    g_spiBytes += size;
+    hostSpiBusy(SPI_BURST_OVERHEAD_NS + size * SPI_BYTE_NS);
+    for (; size > 0; --size, ++src)
+    {
+        hostRadioSpiTransfer(*src);
+    }
+}
+
+// The P2 pull-ups go off, having been on since g_pullupStart. Each pressed button
+// shorts one to ground meanwhile.
+static void hostPullupsOff()
+{
+    int held = 0;
+    for (uint8_t b = g_pressedButtons; b; b &= b - 1)
+    {
+        held++;
+    }
+    g_pullupTime += g_now - g_pullupStart;
+    g_pullupButtonTime += (g_now - g_pullupStart) * held;
+}
+
+// The pins read by the sample: pressed buttons, and any not charged yet
+static uint8_t hostReadKeys()
+{
+    hostUpdateButtons();
+    return g_now - g_pullupStart >= KEY_CHARGE_NS ? g_pressedButtons : 0xFF;
+}
+
+static void timer0Isr()
+{
+    // Turn on pull-up registers
+    g_keyPolls++;
+    g_pullupStart = g_now;
+    hostBusy(KEY_POLL_ISR_NS);
+
+    // Sample on the next tick
+    g_keySampleCompare = hostTicks() + 1;
+    g_keySampleArmed = 1;
+
+    // Schedule the next poll. If we were held off for a whole interval, count from
+    // now rather than waiting for the counter to come round again.
+    g_keyPollCompare += g_keyPollTicks;
+    if (g_keyPollCompare <= hostTicks())
+    {
+        g_keyPollCompare = hostTicks() + g_keyPollTicks;
+    }
+}
+
+static void keySampleIsr()
+{
+    // CCR2: second half of the key poll
+    g_keySampleArmed = 0;
+    hostBusy(KEY_SAMPLE_ISR_NS);
+
+    // Read keys. A new press is only believed when a second sample, a tick later with
+    // the pull-ups still on, agrees.
+    uint8_t buttons = hostReadKeys();
+    if ((buttons & ~g_lastButtons) && !g_keyConfirm)
+    {
+        g_keyConfirm = 1;
+        g_keySampleCompare = hostTicks() + 1;
+        g_keySampleArmed = 1;
+        return;
+    }
+    g_keyConfirm = 0;
+
+    // Change pull-ups to pull-downs
+    hostPullupsOff();
+
+    if (buttons != g_lastButtons)
+    {
+        hostTrace("buttons %02x", buttons);
+        g_lastButtons = buttons;
+        g_lastButtonsTime = halNow();
+        g_interruptSource |= INT_SRC_BUTTON_CHANGE;
+        LPM3_EXIT;
+    }
+}
+
+static void timer1Isr()
+{
+    // CCR1: the deadline
+    g_deadlineArmed = 0;
+    if ((int32_t)(halNow() - g_deadline) >= 0)
+    {
+        g_interruptSource |= INT_SRC_TIMER;
+        LPM3_EXIT;
+    }
+}
+
+static void nullHandler()
+{
+
+}
+
+void halSetDeadlineCallback(EventHandler cb)
+{
+    g_deadlineCB = cb ? cb : nullHandler;
+}
+
+void halSetRadioIRQCallback(EventHandler cb)
+{
+    g_radioIRQCB = cb ? cb : nullHandler;
+}
+
+void halSetButtonChangeCallback(EventHandler cb)
+{
+    g_buttonsCB = cb ? cb : nullHandler;
+}
+
+void halMain(EventHandler initCB)
+{
+    g_trace = getenv("HAL_HOST_TRACE") != 0;
+    // Settings in the script apply from power-up
+    hostReadScript(stdin);
+    hostWorldInit();
+
+    // Radio power-on reset time: 100 ms w/ 25% extra tolerance, slept through in LPM3
+    halSetDeadline(halNow() + halMillisToTicks(125));
+    while (!(g_interruptSource & INT_SRC_TIMER))
+    {
+        if (!hostSleep())
+        {
+            return;
+        }
+        g_gie = 0;
+    }
+    g_interruptSource = 0;
+
+    (initCB)();
+
+    hostEnableInterrupts();
+
+    while(1)
+    {
+        g_gie = 0;
+
+        uint8_t interruptSourceCopy = g_interruptSource;
+        g_lastButtonsCapture = g_lastButtons;
+        g_lastButtonsTimeCapture = g_lastButtonsTime;
+        g_interruptSource = 0;
+
+        if (interruptSourceCopy)
+        {
+            hostEnableInterrupts();
+
+            if (interruptSourceCopy & INT_SRC_BUTTON_CHANGE)
+            {
+                (g_buttonsCB)();
+            }
+
+            if (interruptSourceCopy & INT_SRC_TIMER)
+            {
+                (g_deadlineCB)();
+            }
+
+            if (interruptSourceCopy & INT_SRC_RADIO_IRQ)
+            {
+                (g_radioIRQCB)();
+            }
+        }
+        else if (!hostSleep())
+        {
+            break;
+        }
+    }
+
+    hostReport();
+}
@@ -0,0 +1,73 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+// Host (Linux) stand-in for the MSP430 parts of hal.h.
+//
+// The controller firmware built as a host process with HAL_HOST defined, hal.c swapped
+// for hal_host.c (which mirrors it; see there for what is copied and what is modelled).
+// The other end of the link is the ArduinoRX sketch running on the Arduino core in
+// arduino/. The Makefile builds both into one binary, and the bench scripts use it too:
+//
+//   make -C HostSim
+//   HostSim/build/segagen-host < HostSim/profiles/gameplay.txt
+//
+// The process reads a button script from stdin and runs the firmware on a virtual
+// MSP430 timeline: TIMER0_A key polls, the PORT1 radio IRQ, PORT2 key wakes and LPM3/LPM4
+// in halMain all happen in virtual time, so every run with the same script is identical.
+//
+// Script lines (# starts a comment):
+//   <usec> <buttons>   at time <usec>, the pressed-button mask on P2 becomes <buttons> (hex)
+//   dip <bits>         the DIP switches, as halReadDIP() returns them (hex; four
+//                      switches, see link.h)
+//   end <usec>         stop the simulation at this time
+//   presses <from usec> <to usec> <per second> <hold usec> <buttons> [seed]
+//                      random presses of one of <buttons> (hex) at a time, each held
+//                      <hold usec> give or take half, <per second> on average. Held on
+//                      top of the scripted mask; several lines make chords.
+//   loss <rate> [seed] probability that a packet or ACK is lost in the air
+//   serial <baud>      the receiver's serial baud rate, instead of what it asks for
+//   rxprofile <n>      the receiver's link profile jumpers (see link_profile.h). The
+//                      controller's profile is DIP switches 2 and 3, e.g. "dip 04"
+//                      for profile 1.
+//   signal <dBm> [seed]
+//                      received signal strength at both ends, for range: bit errors
+//                      rise as it nears the sensitivity for the data rate
+//   interferer <first channel> <last channel> <duty> [seed]
+//                      something else busy on those RF channels a <duty> fraction of
+//                      the time, e.g. "interferer 1 23 0.5" for a busy Wi-Fi channel 1
+//   hopackloss <n>     the ACKs of the next <n> packets with a hop confirm are lost
+//   battery <mAh>      battery capacity, for a battery life estimate
+//
+// The report ends with the controller's charge use: the MCU awake and in LPM3/4, and its
+// radio in each power state, at typical datasheet currents (sim_world.cpp). The usage
+// profiles in profiles/ and energy_bench.sh compare it between two versions, and
+// sleep_tier_bench.sh between radio standby windows in sleep mode (sleep.c).
+// loss_bench.sh compares wakeups and latency between two versions under packet loss,
+// and burst_bench.sh an ACKed link profile with the burst one. radio_bench.sh costs
+// each radio driver command in MCLK cycles, for two versions of radio.c.
+//
+// Set HAL_HOST_TRACE=1 in the environment to get a line per event on stderr, and
+// HOST_RX_SERIAL=<file> to capture the receiver's serial output.
+
+#include <stdint.h>
+
+#define BIT0 (1<<0)
+#define BIT1 (1<<1)
+#define BIT2 (1<<2)
+#define BIT3 (1<<3)
+#define BIT4 (1<<4)
+#define BIT5 (1<<5)
+#define BIT6 (1<<6)
+#define BIT7 (1<<7)
+
+void halHostSpiBegin();
+void halHostSpiEnd();
+void halHostDelayMicroseconds(uint32_t usec);
+uint16_t halHostDisableInterrupts();
+void halHostRestoreInterrupts(uint16_t oldSR);
+void halHostSetLed(int on);
+
+// MCU time spent in SPI transfers so far, in virtual nanoseconds (radio_bench.c)
+uint64_t halHostSpiNanoseconds();
+
+#endif /* HAL_HOST_H */
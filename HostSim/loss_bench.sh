@@ -0,0 +1,57 @@
+#!/bin/sh
+# Packet loss benchmark: runs a usage profile on the host simulation at several packet
+# loss rates, built from a git revision (HEAD by default) and from the working tree,
+# and prints how often the controller's MCU woke up, how many sends ended in MAX_RT,
+# the button edge to air latency, the edges the receiver never heard of and the average
+# current for each.
+#
+#   HostSim/loss_bench.sh [revision] [profile]
+#
+# The profile defaults to profiles/gameplay.txt. Pass other rates with
+# LOSSES="0.05 0.5".
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/.." && pwd)
+rev=${1:-HEAD}
+profile=${2:-"$here/profiles/gameplay.txt"}
+losses=${LOSSES:-"0 0.1 0.3"}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# build <source tree> <output binary>, with the Makefile
+build()
+{
+    obj=$(mktemp -d "$work/obj.XXXXXX")
+    make -s -C "$here" SRC="$1" OUT="$obj" WARNINGS=
+    cp "$obj/segagen-host" "$2"
+}
+
+# run <binary> <loss> <label>: one row of the table
+run()
+{
+    { echo "loss $2"; cat "$profile"; } | "$1" | awk -v loss="$2" -v label="$3" '
+        /^wakeups from LPM3:/ { wakeups = $4 }
+        /^radio packets:/ { maxRT = $7 }
+        /^edge to air:/ { mean = $7; max = $10 }
+        /^edges lost:/ { lost = $3 }
+        /^average current:/ { current = $3 }
+        END {
+            printf "%-6s %-14s %8s %7s %14s %12s %5s %9s\n", loss, label, wakeups, maxRT, mean, max,
+                   lost == "" ? "-" : lost, current
+        }'
+}
+
+mkdir "$work/base"
+(cd "$root" && git archive "$rev") | tar -x -C "$work/base"
+build "$work/base" "$work/before"
+build "$root" "$work/after"
+
+printf "%-6s %-14s %8s %7s %14s %12s %5s %9s\n" "loss" "version" "wakeups" "MAX_RT" "edge to air us" "max us" "lost" "mA"
+for loss in $losses
+do
+    run "$work/before" "$loss" "$rev"
+    run "$work/after" "$loss" "working tree"
+done
@@ -0,0 +1,1040 @@
+#include "nrf24_model.h"
+#include <math.h>
+#include <string.h>
+
+#define NS_PER_US           1000ULL
+
+// Timing from the nRF24L01+ product specification
+#define T_STBY2A            (130 * NS_PER_US)
+#define T_PD2STBY           (1500 * NS_PER_US)
+#define T_ACK_TURNAROUND    (130 * NS_PER_US)
+
+#define REG_CONFIG          0x00
+#define REG_EN_AA           0x01
+#define REG_EN_RXADDR       0x02
+#define REG_SETUP_AW        0x03
+#define REG_SETUP_RETR      0x04
+#define REG_RF_CH           0x05
+#define REG_RF_SETUP        0x06
+#define REG_STATUS          0x07
+#define REG_OBSERVE_TX      0x08
+#define REG_RPD             0x09
+#define REG_RX_ADDR_P0      0x0A
+#define REG_RX_ADDR_P1      0x0B
+#define REG_TX_ADDR         0x10
+#define REG_RX_PW_P0        0x11
+#define REG_FIFO_STATUS     0x17
+#define REG_DYNPD           0x1C
+#define REG_FEATURE         0x1D
+
+#define STATUS_RX_DR        0x40
+#define STATUS_TX_DS        0x20
+#define STATUS_MAX_RT       0x10
+#define STATUS_IRQ_MASK     (STATUS_RX_DR | STATUS_TX_DS | STATUS_MAX_RT)
+
+#define FEATURE_EN_DPL      0x04
+#define FEATURE_EN_ACK_PAY  0x02
+#define FEATURE_EN_DYN_ACK  0x01
+
+#define FIFO_DEPTH          3
+#define MAX_PAYLOAD         32
+
+// RPD goes high on -64 dBm or more for at least this long
+#define T_RPD               (40 * NS_PER_US)
+
+// Interferer on/off granularity, about one Wi-Fi frame
+#define INTERFERENCE_SLOT_NS (250 * NS_PER_US)
+
+//------------------------------ Nrf24Model -----------------------------------
+
+Nrf24Model::Nrf24Model(RFMedium& medium, const char* name) :
+    m_statTransmissions(0),
+    m_statPacketsAcked(0),
+    m_statMaxRT(0),
+    m_statReceived(0),
+    m_statRxFifoFull(0),
+    m_statAirTime(0),
+    m_statPowerUps(0),
+    m_statWakes(0),
+    m_statWakeTransactions(0),
+    m_statMaxWakeTransactions(0),
+    m_statPowerDownTime(0),
+    m_statStartupTime(0),
+    m_statStandbyTime(0),
+    m_statStandbyIITime(0),
+    m_statSettleTime(0),
+    m_statTxTime(0),
+    m_statRxTime(0),
+    m_medium(medium),
+    m_name(name),
+    m_now(0),
+    m_lastAccountTime(0),
+    m_csnLow(false),
+    m_powerDownTransactions(0),
+    m_waking(false),
+    m_byteIndex(0),
+    m_command(0),
+    m_reuseTX(false),
+    m_ce(false),
+    m_ceHighTime(0),
+    m_standbyReadyTime(0),
+    m_txPhase(TX_IDLE),
+    m_txEventTime(0),
+    m_txStartTime(0),
+    m_pid(0),
+    m_arcCount(0),
+    m_plosCount(0),
+    m_ackReceived(false),
+    m_ackTimeout(0),
+    m_ackEnd(0),
+    m_ackCut(false),
+    m_rpd(false),
+    m_localTime(0)
+{
+    // Reset values
+    memset(m_regs, 0, sizeof(m_regs));
+    m_regs[REG_CONFIG] = 0x08;
+    m_regs[REG_EN_AA] = 0x3F;
+    m_regs[REG_EN_RXADDR] = 0x03;
+    m_regs[REG_SETUP_AW] = 0x03;
+    m_regs[REG_SETUP_RETR] = 0x03;
+    m_regs[REG_RF_CH] = 0x02;
+    m_regs[REG_RF_SETUP] = 0x0E;
+    m_regs[0x0C] = 0xC3;
+    m_regs[0x0D] = 0xC4;
+    m_regs[0x0E] = 0xC5;
+    m_regs[0x0F] = 0xC6;
+    memset(m_rxAddrP0, 0xE7, sizeof(m_rxAddrP0));
+    memset(m_rxAddrP1, 0xC2, sizeof(m_rxAddrP1));
+    memset(m_txAddr, 0xE7, sizeof(m_txAddr));
+
+    for (int i = 0; i < 6; ++i)
+    {
+        m_lastPid[i] = -1;
+    }
+
+    m_medium.attach(this);
+}
+
+uint8_t Nrf24Model::status() const
+{
+    uint8_t rxPipe = m_rxFifo.empty() ? 7 : m_rxFifo.front().pipe;
+    return (m_regs[REG_STATUS] & STATUS_IRQ_MASK) |
+           (rxPipe << 1) |
+           (m_txFifo.size() >= FIFO_DEPTH ? 0x01 : 0);
+}
+
+uint8_t Nrf24Model::fifoStatus() const
+{
+    return (m_reuseTX ? 0x40 : 0) |
+           (m_txFifo.size() >= FIFO_DEPTH ? 0x20 : 0) |
+           (m_txFifo.empty() ? 0x10 : 0) |
+           (m_rxFifo.size() >= FIFO_DEPTH ? 0x02 : 0) |
+           (m_rxFifo.empty() ? 0x01 : 0);
+}
+
+int Nrf24Model::addressWidth() const
+{
+    int aw = m_regs[REG_SETUP_AW] & 0x03;
+    return aw ? aw + 2 : 5;
+}
+
+int Nrf24Model::crcLength() const
+{
+    if (!(m_regs[REG_CONFIG] & 0x08))
+    {
+        // CRC is forced on whenever auto-ack is enabled on any pipe
+        return m_regs[REG_EN_AA] ? 1 : 0;
+    }
+    return (m_regs[REG_CONFIG] & 0x04) ? 2 : 1;
+}
+
+uint8_t* Nrf24Model::registerBytes(uint8_t reg, int* size)
+{
+    *size = 5;
+    switch (reg)
+    {
+    case REG_RX_ADDR_P0:
+        return m_rxAddrP0;
+    case REG_RX_ADDR_P1:
+        return m_rxAddrP1;
+    case REG_TX_ADDR:
+        return m_txAddr;
+    default:
+        *size = 1;
+        return &m_regs[reg];
+    }
+}
+
+bool Nrf24Model::irqAsserted() const
+{
+    // CONFIG bits 6:4 mask the matching STATUS bits from the IRQ pin
+    return (m_regs[REG_STATUS] & STATUS_IRQ_MASK & ~m_regs[REG_CONFIG]) != 0;
+}
+
+void Nrf24Model::setIRQFlags(uint8_t flags)
+{
+    m_regs[REG_STATUS] |= flags;
+}
+
+void Nrf24Model::writeRegister(uint8_t reg, int index, uint8_t value)
+{
+    if (reg > REG_FEATURE)
+    {
+        return;
+    }
+
+    if ((reg == REG_CONFIG || reg == REG_RF_CH || reg == REG_RF_SETUP) && value != m_regs[reg])
+    {
+        disturbAck();
+    }
+
+    switch (reg)
+    {
+    case REG_STATUS:
+        // Write 1 to clear
+        m_regs[REG_STATUS] &= ~(value & STATUS_IRQ_MASK);
+        if (value & STATUS_MAX_RT)
+        {
+            maybeStartTX();
+        }
+        return;
+
+    case REG_OBSERVE_TX:
+    case REG_RPD:
+    case REG_FIFO_STATUS:
+        // Read-only
+        return;
+
+    case REG_RF_CH:
+        m_plosCount = 0;
+        break;
+
+    case REG_CONFIG:
+        accountState();
+        if ((value & 0x02) && !poweredUp())
+        {
+            m_standbyReadyTime = m_now + T_PD2STBY;
+            m_waking = m_statPowerUps++ != 0;
+        }
+        else if (!(value & 0x02))
+        {
+            m_txPhase = TX_IDLE;
+            if (poweredUp())
+            {
+                m_powerDownTransactions = 0;
+                m_waking = false;
+            }
+        }
+        break;
+    }
+
+    int size;
+    uint8_t* bytes = registerBytes(reg, &size);
+    if (index < size)
+    {
+        bytes[index] = value;
+    }
+}
+
+void Nrf24Model::setCSN(bool high)
+{
+    if (!high && !m_csnLow)
+    {
+        m_csnLow = true;
+        m_byteIndex = 0;
+        if (!poweredUp() || m_waking)
+        {
+            m_powerDownTransactions++;
+        }
+        m_commandData.clear();
+    }
+    else if (high && m_csnLow)
+    {
+        m_csnLow = false;
+        commandEnd();
+    }
+}
+
+uint8_t Nrf24Model::spiTransfer(uint8_t mosi)
+{
+    if (!m_csnLow)
+    {
+        return 0xFF;
+    }
+
+    uint8_t miso = 0;
+
+    if (m_byteIndex == 0)
+    {
+        // STATUS is clocked out while the command byte is clocked in
+        miso = status();
+        m_command = mosi;
+
+        if (mosi == 0xE1)
+        {
+            m_txFifo.clear();
+            m_reuseTX = false;
+        }
+        else if (mosi == 0xE2)
+        {
+            m_rxFifo.clear();
+        }
+        else if (mosi == 0xE3)
+        {
+            m_reuseTX = true;
+        }
+    }
+    else
+    {
+        int index = m_byteIndex - 1;
+
+        if ((m_command & 0xE0) == 0x00)
+        {
+            // R_REGISTER
+            uint8_t reg = m_command & 0x1F;
+            if (reg == REG_STATUS)
+            {
+                miso = status();
+            }
+            else if (reg == REG_FIFO_STATUS)
+            {
+                miso = fifoStatus();
+            }
+            else if (reg == REG_OBSERVE_TX)
+            {
+                miso = (m_plosCount << 4) | m_arcCount;
+            }
+            else if (reg == REG_RPD)
+            {
+                uint64_t t = localNow();
+                bool carrier = poweredUp() && primaryRX() && m_ce &&
+                               m_medium.interfered(channel(), t > T_RPD ? t - T_RPD : 0, t);
+                miso = (m_rpd || carrier) ? 1 : 0;
+            }
+            else if (reg <= REG_FEATURE)
+            {
+                int size;
+                uint8_t* bytes = registerBytes(reg, &size);
+                miso = index < size ? bytes[index] : 0;
+            }
+        }
+        else if ((m_command & 0xE0) == 0x20)
+        {
+            // W_REGISTER
+            writeRegister(m_command & 0x1F, index, mosi);
+        }
+        else if (m_command == 0x61)
+        {
+            // R_RX_PAYLOAD
+            if (!m_rxFifo.empty() && index < (int)m_rxFifo.front().payload.size())
+            {
+                miso = m_rxFifo.front().payload[index];
+            }
+        }
+        else if (m_command == 0x60)
+        {
+            // R_RX_PL_WID
+            miso = m_rxFifo.empty() ? 0 : (uint8_t)m_rxFifo.front().payload.size();
+        }
+        else if (m_command == 0xA0 || m_command == 0xB0 || (m_command & 0xF8) == 0xA8)
+        {
+            // W_TX_PAYLOAD, W_TX_PAYLOAD_NOACK, W_ACK_PAYLOAD
+            if (m_commandData.size() < MAX_PAYLOAD)
+            {
+                m_commandData.push_back(mosi);
+            }
+        }
+    }
+
+    m_byteIndex++;
+    return miso;
+}
+
+void Nrf24Model::commandEnd()
+{
+    if (m_command == 0x61 && m_byteIndex > 1 && !m_rxFifo.empty())
+    {
+        m_rxFifo.erase(m_rxFifo.begin());
+    }
+    else if (m_command == 0x60 && m_byteIndex > 1 && !m_rxFifo.empty() && m_rxFifo.front().payload.size() > MAX_PAYLOAD)
+    {
+        m_rxFifo.clear();
+    }
+    else if ((m_command == 0xA0 || m_command == 0xB0 || (m_command & 0xF8) == 0xA8) && !m_commandData.empty())
+    {
+        bool noAck = m_command == 0xB0;
+        bool ackPayload = (m_command & 0xF8) == 0xA8;
+
+        if ((noAck && !(m_regs[REG_FEATURE] & FEATURE_EN_DYN_ACK)) ||
+            (ackPayload && !(m_regs[REG_FEATURE] & FEATURE_EN_ACK_PAY)) ||
+            m_txFifo.size() >= FIFO_DEPTH)
+        {
+            return;
+        }
+
+        if (m_waking && !ackPayload)
+        {
+            // Up to this payload, not counting it
+            uint32_t transactions = m_powerDownTransactions - 1;
+            m_statWakes++;
+            m_statWakeTransactions += transactions;
+            if (transactions > m_statMaxWakeTransactions)
+            {
+                m_statMaxWakeTransactions = transactions;
+            }
+            m_waking = false;
+        }
+
+        FifoEntry entry;
+        entry.payload = m_commandData;
+        entry.pipe = ackPayload ? (m_command & 0x07) : 0;
+        entry.noAck = noAck;
+        entry.sent = false;
+        m_txFifo.push_back(entry);
+        m_reuseTX = false;
+
+        maybeStartTX();
+    }
+}
+
+void Nrf24Model::setCE(bool high)
+{
+    if (high == m_ce)
+    {
+        return;
+    }
+
+    accountState();
+    m_ce = high;
+    if (!high)
+    {
+        disturbAck();
+    }
+
+    if (high)
+    {
+        m_ceHighTime = m_now;
+        m_rpd = false;
+        maybeStartTX();
+    }
+}
+
+bool Nrf24Model::txAvailable() const
+{
+    return (!m_txFifo.empty() || m_reuseTX) && !(m_regs[REG_STATUS] & STATUS_MAX_RT);
+}
+
+void Nrf24Model::maybeStartTX()
+{
+    if (poweredUp() && !primaryRX() && m_ce && m_txPhase == TX_IDLE && txAvailable())
+    {
+        uint64_t start = m_now > m_standbyReadyTime ? m_now : m_standbyReadyTime;
+        m_txPhase = TX_SETTLE;
+        m_txEventTime = start + T_STBY2A;
+    }
+}
+
+void Nrf24Model::transmitHead(bool retransmit)
+{
+    if (!retransmit)
+    {
+        m_arcCount = 0;
+        if (!m_reuseTX)
+        {
+            m_pid = (m_pid + 1) & 0x03;
+        }
+    }
+
+    const FifoEntry& entry = m_reuseTX && !m_lastTransmitted.payload.empty() ? m_lastTransmitted : m_txFifo.front();
+
+    m_packet.addressWidth = addressWidth();
+    memcpy(m_packet.address, m_txAddr, sizeof(m_packet.address));
+    m_packet.channel = m_regs[REG_RF_CH] & 0x7F;
+    m_packet.dataRate = m_regs[REG_RF_SETUP] & 0x28;
+    m_packet.crcLength = crcLength();
+    m_packet.pid = m_pid;
+    m_packet.noAck = entry.noAck;
+    m_packet.payload = entry.payload;
+
+    uint64_t air = RFMedium::airTime(m_packet);
+
+    accountState();
+    m_txPhase = TX_ON_AIR;
+    m_txStartTime = m_now;
+    m_txEventTime = m_now + air;
+    m_medium.beginTransmission(this, m_packet.channel, m_txStartTime, m_txEventTime);
+
+    m_statTransmissions++;
+    m_statAirTime += air;
+}
+
+void Nrf24Model::onTXEnd()
+{
+    accountState();
+    m_ack = m_medium.deliver(this, m_packet, m_txStartTime);
+
+    bool needAck = (m_regs[REG_EN_AA] & 0x01) && !m_packet.noAck;
+    if (!needAck)
+    {
+        finishPacket();
+        return;
+    }
+
+    // ARD counts from the end of one transmission to the start of the next
+    uint64_t ard = (uint64_t)((m_regs[REG_SETUP_RETR] >> 4) + 1) * 250 * NS_PER_US;
+    uint64_t ackArrival = m_now + T_ACK_TURNAROUND + RFMedium::ackAirTime(m_packet, (int)m_ack.payload.size());
+
+    m_txPhase = TX_WAIT_ACK;
+    m_ackTimeout = m_now + ard;
+    m_ackReceived = m_ack.sent && ackArrival <= m_ackTimeout &&
+                    !m_medium.ackLost(m_packet, (int)m_ack.payload.size(), m_now + T_ACK_TURNAROUND, ackArrival);
+    m_txEventTime = m_ackReceived ? ackArrival : m_ackTimeout;
+}
+
+void Nrf24Model::onAckResult()
+{
+    // The PRX may have cut the ACK off since (e.g. moved to another channel): then
+    // there's nothing to hear, and the rest of ARD to wait out
+    if (m_ackReceived && !m_ack.from->ackCompleted())
+    {
+        m_ackReceived = false;
+        if (m_ackTimeout > m_now)
+        {
+            m_txEventTime = m_ackTimeout;
+            return;
+        }
+    }
+
+    if (m_ackReceived)
+    {
+        if (!m_ack.payload.empty() && m_rxFifo.size() < FIFO_DEPTH)
+        {
+            FifoEntry entry;
+            entry.payload = m_ack.payload;
+            entry.pipe = 0;
+            entry.noAck = false;
+            entry.sent = false;
+            m_rxFifo.push_back(entry);
+            setIRQFlags(STATUS_RX_DR);
+        }
+
+        m_statPacketsAcked++;
+        finishPacket();
+    }
+    else if (m_arcCount < (m_regs[REG_SETUP_RETR] & 0x0F))
+    {
+        m_arcCount++;
+        transmitHead(true);
+    }
+    else
+    {
+        accountState();
+        if (m_plosCount < 15)
+        {
+            m_plosCount++;
+        }
+        m_statMaxRT++;
+        m_txPhase = TX_IDLE;
+        setIRQFlags(STATUS_MAX_RT);
+    }
+}
+
+void Nrf24Model::finishPacket()
+{
+    accountState();
+
+    if (!m_reuseTX && !m_txFifo.empty())
+    {
+        m_lastTransmitted = m_txFifo.front();
+        m_txFifo.erase(m_txFifo.begin());
+    }
+
+    setIRQFlags(STATUS_TX_DS);
+
+    // With CE held high the next payload goes straight out; otherwise back to standby
+    m_txPhase = TX_IDLE;
+    if (m_ce && txAvailable())
+    {
+        transmitHead(false);
+    }
+}
+
+uint64_t Nrf24Model::nextEventTime() const
+{
+    return m_txPhase == TX_IDLE ? UINT64_MAX : m_txEventTime;
+}
+
+void Nrf24Model::advance(uint64_t now)
+{
+    while (m_txPhase != TX_IDLE && m_txEventTime <= now)
+    {
+        m_now = m_txEventTime;
+
+        switch (m_txPhase)
+        {
+        case TX_SETTLE:
+            transmitHead(false);
+            break;
+        case TX_ON_AIR:
+            onTXEnd();
+            break;
+        case TX_WAIT_ACK:
+            onAckResult();
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_now = now;
+    accountState();
+}
+
+void Nrf24Model::accountState()
+{
+    uint64_t elapsed = m_now - m_lastAccountTime;
+    uint64_t since = m_lastAccountTime;
+    m_lastAccountTime = m_now;
+
+    if (!poweredUp())
+    {
+        m_statPowerDownTime += elapsed;
+        return;
+    }
+
+    // The crystal is still starting up (nothing else can happen until it has)
+    if (since < m_standbyReadyTime)
+    {
+        uint64_t startup = (m_now < m_standbyReadyTime ? m_now : m_standbyReadyTime) - since;
+        m_statStartupTime += startup;
+        elapsed -= startup;
+    }
+
+    if (m_txPhase == TX_SETTLE)
+    {
+        m_statSettleTime += elapsed;
+    }
+    else if (m_txPhase == TX_ON_AIR)
+    {
+        m_statTxTime += elapsed;
+    }
+    else if (m_txPhase == TX_WAIT_ACK || (primaryRX() && m_ce))
+    {
+        m_statRxTime += elapsed;
+    }
+    else if (m_ce)
+    {
+        m_statStandbyIITime += elapsed;
+    }
+    else
+    {
+        m_statStandbyTime += elapsed;
+    }
+}
+
+bool Nrf24Model::isListening(uint64_t since) const
+{
+    return poweredUp() && primaryRX() && m_ce &&
+           m_ceHighTime + T_STBY2A <= since &&
+           m_standbyReadyTime + T_STBY2A <= since &&
+           m_ackEnd <= since;
+}
+
+bool Nrf24Model::matchesAddress(const RFPacket& pkt, int* pipe) const
+{
+    int aw = addressWidth();
+    if (pkt.channel != (m_regs[REG_RF_CH] & 0x7F) ||
+        pkt.dataRate != (m_regs[REG_RF_SETUP] & 0x28) ||
+        pkt.addressWidth != aw ||
+        pkt.crcLength != crcLength())
+    {
+        return false;
+    }
+
+    for (int p = 0; p < 6; ++p)
+    {
+        if (!(m_regs[REG_EN_RXADDR] & (1 << p)))
+        {
+            continue;
+        }
+
+        uint8_t addr[5];
+        if (p == 0)
+        {
+            memcpy(addr, m_rxAddrP0, sizeof(addr));
+        }
+        else
+        {
+            // Pipes 2-5 share all but the LSByte with pipe 1
+            memcpy(addr, m_rxAddrP1, sizeof(addr));
+            if (p > 1)
+            {
+                addr[0] = m_regs[REG_RX_ADDR_P0 + p];
+            }
+        }
+
+        if (memcmp(addr, pkt.address, aw) == 0)
+        {
+            *pipe = p;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+RFAck Nrf24Model::receive(const RFPacket& pkt, int pipe, uint64_t start)
+{
+    RFAck ack;
+    ack.sent = false;
+    ack.from = this;
+
+    bool dynamic = (m_regs[REG_FEATURE] & FEATURE_EN_DPL) && (m_regs[REG_DYNPD] & (1 << pipe));
+    if (!dynamic && pkt.payload.size() != m_regs[REG_RX_PW_P0 + pipe])
+    {
+        return ack;
+    }
+
+    bool duplicate = m_lastPid[pipe] == pkt.pid && m_lastPayload[pipe] == pkt.payload;
+    if (!duplicate)
+    {
+        if (m_rxFifo.size() >= FIFO_DEPTH)
+        {
+            // No room: the packet is dropped and not acknowledged
+            m_statRxFifoFull++;
+            return ack;
+        }
+
+        FifoEntry entry;
+        entry.payload = pkt.payload;
+        entry.pipe = pipe;
+        entry.noAck = pkt.noAck;
+        entry.sent = false;
+        m_rxFifo.push_back(entry);
+        m_lastPid[pipe] = pkt.pid;
+        m_lastPayload[pipe] = pkt.payload;
+        m_statReceived++;
+        setIRQFlags(STATUS_RX_DR);
+
+        if (m_onReceive)
+        {
+            m_onReceive(pkt, pipe, start);
+        }
+    }
+
+    if ((m_regs[REG_EN_AA] & (1 << pipe)) && !pkt.noAck)
+    {
+        ack.sent = true;
+
+        if (m_regs[REG_FEATURE] & FEATURE_EN_ACK_PAY)
+        {
+            // The pipe's last ACK payload goes again with the ACK of a retransmit. A new
+            // packet shows the PTX got it: only then is it gone, and TX_DS set.
+            for (size_t i = 0; i < m_txFifo.size() && !duplicate; ++i)
+            {
+                if (m_txFifo[i].pipe == pipe && m_txFifo[i].sent)
+                {
+                    m_txFifo.erase(m_txFifo.begin() + i);
+                    setIRQFlags(STATUS_TX_DS);
+                    break;
+                }
+            }
+
+            for (size_t i = 0; i < m_txFifo.size(); ++i)
+            {
+                if (m_txFifo[i].pipe == pipe)
+                {
+                    ack.payload = m_txFifo[i].payload;
+                    m_txFifo[i].sent = true;
+                    break;
+                }
+            }
+        }
+
+        // Not listening again until the ACK is out
+        uint64_t ackStart = start + RFMedium::airTime(pkt) + T_ACK_TURNAROUND;
+        m_ackEnd = ackStart + RFMedium::ackAirTime(pkt, (int)ack.payload.size());
+        m_ackCut = false;
+        m_medium.beginTransmission(this, pkt.channel, ackStart, m_ackEnd);
+    }
+
+    return ack;
+}
+
+void Nrf24Model::disturbAck()
+{
+    if (localNow() < m_ackEnd)
+    {
+        m_ackCut = true;
+    }
+}
+
+void Nrf24Model::carrierDetected(uint8_t channel)
+{
+    if (channel == this->channel())
+    {
+        m_rpd = true;
+    }
+}
+
+//------------------------------ RFMedium -------------------------------------
+
+// Preamble, address, 9-bit packet control field, payload, CRC
+static uint64_t packetBits(const RFPacket& pkt)
+{
+    return 8 * (1 + pkt.addressWidth + pkt.payload.size() + pkt.crcLength) + 9;
+}
+
+static uint64_t ackBits(const RFPacket& pkt, int ackPayloadSize)
+{
+    return 8 * (1 + pkt.addressWidth + ackPayloadSize + pkt.crcLength) + 9;
+}
+
+RFMedium::RFMedium() :
+    m_now(0),
+    m_lossThreshold(0),
+    m_rng(1),
+    m_hasSignal(false),
+    m_signalDbm(0),
+    m_signalRng(1)
+{
+}
+
+void RFMedium::attach(Nrf24Model* radio)
+{
+    m_radios.push_back(radio);
+}
+
+void RFMedium::setLossRate(double lossRate, uint32_t seed)
+{
+    m_lossThreshold = (uint32_t)(lossRate * 4294967295.0);
+    m_rng = seed ? seed : 1;
+}
+
+bool RFMedium::lose()
+{
+    if (!m_lossThreshold)
+    {
+        return false;
+    }
+
+    // xorshift32
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return m_rng < m_lossThreshold;
+}
+
+void RFMedium::setSignal(double dBm, uint32_t seed)
+{
+    m_hasSignal = true;
+    m_signalDbm = dBm;
+    m_signalRng = seed ? seed : 1;
+}
+
+// Sensitivity at 0.1% BER, from the nRF24L01+ datasheet
+static double sensitivityDbm(uint8_t dataRate)
+{
+    return (dataRate & 0x20) ? -94.0 : (dataRate & 0x08) ? -82.0 : -85.0;
+}
+
+bool RFMedium::weakSignalLost(uint8_t dataRate, uint64_t bits)
+{
+    if (!m_hasSignal)
+    {
+        return false;
+    }
+
+    // 0.1% BER at the sensitivity, and ten times better for every 2 dB above it
+    double ber = 1e-3 * pow(10.0, (sensitivityDbm(dataRate) - m_signalDbm) / 2.0);
+    if (ber > 0.5)
+    {
+        ber = 0.5;
+    }
+    double packetErrorRate = 1.0 - pow(1.0 - ber, (double)bits);
+
+    // xorshift32
+    m_signalRng ^= m_signalRng << 13;
+    m_signalRng ^= m_signalRng >> 17;
+    m_signalRng ^= m_signalRng << 5;
+    return m_signalRng < packetErrorRate * 4294967295.0;
+}
+
+bool RFMedium::ackLost(const RFPacket& pkt, int ackPayloadSize, uint64_t start, uint64_t end)
+{
+    if (m_loseAck && m_loseAck(pkt))
+    {
+        return true;
+    }
+
+    return interfered(pkt.channel, start, end) ||
+           weakSignalLost(pkt.dataRate, ackBits(pkt, ackPayloadSize)) || lose();
+}
+
+void RFMedium::addInterferer(uint8_t firstChannel, uint8_t lastChannel, double duty, uint32_t seed)
+{
+    Interferer interferer;
+    interferer.firstChannel = firstChannel;
+    interferer.lastChannel = lastChannel;
+    interferer.dutyThreshold = (uint32_t)(duty * 4294967295.0);
+    interferer.seed = seed;
+    m_interferers.push_back(interferer);
+}
+
+bool RFMedium::interfered(uint8_t channel, uint64_t start, uint64_t end) const
+{
+    for (size_t i = 0; i < m_interferers.size(); ++i)
+    {
+        const Interferer& in = m_interferers[i];
+        if (channel < in.firstChannel || channel > in.lastChannel)
+        {
+            continue;
+        }
+
+        // Whether a slot is busy is a hash of its index, so any time can be asked about
+        for (uint64_t slot = start / INTERFERENCE_SLOT_NS; slot <= end / INTERFERENCE_SLOT_NS; ++slot)
+        {
+            uint32_t h = ((uint32_t)slot * 0x9E3779B9u) ^ in.seed;
+            h ^= h >> 16;
+            h *= 0x7FEB352Du;
+            h ^= h >> 15;
+            h *= 0x846CA68Bu;
+            h ^= h >> 16;
+            if (h < in.dutyThreshold)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+uint64_t RFMedium::nextEventTime() const
+{
+    uint64_t next = UINT64_MAX;
+    for (size_t i = 0; i < m_radios.size(); ++i)
+    {
+        uint64_t t = m_radios[i]->nextEventTime();
+        if (t < next)
+        {
+            next = t;
+        }
+    }
+    return next;
+}
+
+void RFMedium::advance(uint64_t now)
+{
+    for (;;)
+    {
+        Nrf24Model* first = 0;
+        uint64_t next = UINT64_MAX;
+        for (size_t i = 0; i < m_radios.size(); ++i)
+        {
+            uint64_t t = m_radios[i]->nextEventTime();
+            if (t < next)
+            {
+                next = t;
+                first = m_radios[i];
+            }
+        }
+
+        if (!first || next > now)
+        {
+            break;
+        }
+
+        if (next > m_now)
+        {
+            m_now = next;
+        }
+        first->advance(next);
+    }
+
+    if (now > m_now)
+    {
+        m_now = now;
+    }
+
+    for (size_t i = 0; i < m_radios.size(); ++i)
+    {
+        m_radios[i]->advance(m_now);
+    }
+}
+
+void RFMedium::beginTransmission(Nrf24Model* from, uint8_t channel, uint64_t start, uint64_t end)
+{
+    // Forget transmissions that can no longer overlap anything
+    while (!m_transmissions.empty() && m_transmissions.front().end + 10000 * NS_PER_US < start)
+    {
+        m_transmissions.erase(m_transmissions.begin());
+    }
+
+    Transmission t;
+    t.from = from;
+    t.channel = channel;
+    t.start = start;
+    t.end = end;
+    m_transmissions.push_back(t);
+}
+
+bool RFMedium::collided(Nrf24Model* from, uint8_t channel, uint64_t start, uint64_t end) const
+{
+    for (size_t i = 0; i < m_transmissions.size(); ++i)
+    {
+        const Transmission& t = m_transmissions[i];
+        if (t.from != from && t.channel == channel && t.start < end && start < t.end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+RFAck RFMedium::deliver(Nrf24Model* from, const RFPacket& pkt, uint64_t start)
+{
+    RFAck none;
+    none.sent = false;
+    none.from = 0;
+
+    bool corrupted = collided(from, pkt.channel, start, m_now) ||
+                     interfered(pkt.channel, start, m_now) ||
+                     weakSignalLost(pkt.dataRate, packetBits(pkt)) || lose();
+
+    for (size_t i = 0; i < m_radios.size(); ++i)
+    {
+        Nrf24Model* radio = m_radios[i];
+        int pipe;
+
+        if (radio == from || !radio->isListening(start))
+        {
+            continue;
+        }
+
+        radio->carrierDetected(pkt.channel);
+
+        if (!corrupted && radio->matchesAddress(pkt, &pipe))
+        {
+            return radio->receive(pkt, pipe, start);
+        }
+    }
+
+    return none;
+}
+
+static uint64_t bitsToTime(uint64_t bits, uint8_t dataRate)
+{
+    uint64_t bitsPerSecond = (dataRate & 0x20) ? 250000 : (dataRate & 0x08) ? 2000000 : 1000000;
+    return bits * 1000000000ULL / bitsPerSecond;
+}
+
+uint64_t RFMedium::airTime(const RFPacket& pkt)
+{
+    return bitsToTime(packetBits(pkt), pkt.dataRate);
+}
+
+uint64_t RFMedium::ackAirTime(const RFPacket& pkt, int ackPayloadSize)
+{
+    return bitsToTime(ackBits(pkt, ackPayloadSize), pkt.dataRate);
+}
@@ -0,0 +1,256 @@
+#ifndef NRF24_MODEL_H
+#define NRF24_MODEL_H
+
+// Behavioral model of the nRF24L01+, driven through its pins (CSN, SCK/MOSI/MISO as
+// whole bytes, CE, IRQ) and linked to other radios through an RFMedium.
+//
+// Models the SPI command set, the register file, 3-deep TX/RX FIFOs and Enhanced
+// ShockBurst: PID, auto-ack, ACK payloads, ARD/ARC retransmits, OBSERVE_TX and IRQ.
+// Not modeled: the CONT_WAVE / PLL_LOCK test modes and the legacy ACTIVATE command.
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+class RFMedium;
+class Nrf24Model;
+
+struct RFPacket
+{
+    uint8_t address[5];
+    uint8_t addressWidth;
+    uint8_t channel;
+    uint8_t dataRate;       // RF_SETUP RF_DR bits
+    uint8_t crcLength;      // 0, 1 or 2
+    uint8_t pid;
+    bool noAck;
+    std::vector<uint8_t> payload;
+};
+
+struct RFAck
+{
+    bool sent;
+    std::vector<uint8_t> payload;
+    Nrf24Model* from;       // the PRX sending it
+};
+
+class Nrf24Model
+{
+public:
+    Nrf24Model(RFMedium& medium, const char* name);
+
+    // Pins
+    void setCSN(bool high);
+    uint8_t spiTransfer(uint8_t mosi);
+    void setCE(bool high);
+    bool irqAsserted() const;
+
+    // Time. advance() processes internal events up to and including 'now'.
+    uint64_t nextEventTime() const;
+    void advance(uint64_t now);
+
+    const char* name() const { return m_name; }
+    uint8_t channel() const { return m_regs[0x05] & 0x7F; }
+    uint8_t reg(uint8_t address) const { return m_regs[address & 0x1F]; }
+
+    // The host MCU's own clock, when it runs ahead of the medium (a sketch busy in a
+    // loop of its own). RPD samples interference at this time rather than the medium's.
+    void setLocalTime(uint64_t time) { m_localTime = time; }
+
+    // Called by the medium when a packet ends.
+    bool isListening(uint64_t since) const;
+    bool matchesAddress(const RFPacket& pkt, int* pipe) const;
+    RFAck receive(const RFPacket& pkt, int pipe, uint64_t start);
+    void carrierDetected(uint8_t channel);
+
+    // Whether the last ACK this PRX sent went out whole: changing RF_CH, RF_SETUP or
+    // CONFIG, or dropping CE, before it ends cuts it off
+    bool ackCompleted() const { return !m_ackCut; }
+
+    // Called for every packet stored in the RX FIFO, with the time it started on air
+    std::function<void(const RFPacket&, int pipe, uint64_t start)> m_onReceive;
+
+    // Statistics
+    uint32_t m_statTransmissions;
+    uint32_t m_statPacketsAcked;
+    uint32_t m_statMaxRT;
+    uint32_t m_statReceived;
+    uint32_t m_statRxFifoFull;      // packets dropped (and not acked) for want of room
+    uint64_t m_statAirTime;
+
+    // Wakes from power-down: the SPI transactions from powering down to the first
+    // payload written after powering up again. The power-up after reset isn't a wake.
+    uint32_t m_statPowerUps;
+    uint32_t m_statWakes;
+    uint32_t m_statWakeTransactions;
+    uint32_t m_statMaxWakeTransactions;
+
+    // Time in each power state, for the energy report
+    uint64_t m_statPowerDownTime;
+    uint64_t m_statStartupTime;     // crystal start-up after PWR_UP (Tpd2stby)
+    uint64_t m_statStandbyTime;     // Standby-I
+    uint64_t m_statStandbyIITime;   // PTX with CE high and nothing to send
+    uint64_t m_statSettleTime;      // PLL settling before each packet (Tstby2a)
+    uint64_t m_statTxTime;
+    uint64_t m_statRxTime;
+
+private:
+    struct FifoEntry
+    {
+        std::vector<uint8_t> payload;
+        uint8_t pipe;       // RX: pipe it came from; TX: pipe of an ACK payload
+        bool noAck;
+        bool sent;          // ACK payload: went with an ACK, kept until a new packet
+    };
+
+    enum TxPhase
+    {
+        TX_IDLE,
+        TX_SETTLE,          // Tstby2a before the packet goes out
+        TX_ON_AIR,          // packet being transmitted
+        TX_WAIT_ACK,        // listening for the ACK
+    };
+
+    uint8_t status() const;
+    uint8_t fifoStatus() const;
+    bool poweredUp() const { return (m_regs[0x00] & 0x02) != 0; }
+    bool primaryRX() const { return (m_regs[0x00] & 0x01) != 0; }
+    int addressWidth() const;
+    int crcLength() const;
+    uint8_t *registerBytes(uint8_t reg, int* size);
+    void writeRegister(uint8_t reg, int index, uint8_t value);
+    void commandEnd();
+    void setIRQFlags(uint8_t flags);
+    bool txAvailable() const;
+    void maybeStartTX();
+    void transmitHead(bool retransmit);
+    void onTXEnd();
+    void onAckResult();
+    void finishPacket();
+    void accountState();
+    uint64_t localNow() const { return m_localTime > m_now ? m_localTime : m_now; }
+    void disturbAck();
+
+    RFMedium& m_medium;
+    const char* m_name;
+    uint64_t m_now;
+    uint64_t m_lastAccountTime;
+
+    // Register file (multi-byte registers are kept separately)
+    uint8_t m_regs[0x20];
+    uint8_t m_rxAddrP0[5];
+    uint8_t m_rxAddrP1[5];
+    uint8_t m_txAddr[5];
+
+    // SPI command in progress
+    bool m_csnLow;
+    uint32_t m_powerDownTransactions;
+    bool m_waking;
+    int m_byteIndex;
+    uint8_t m_command;
+    std::vector<uint8_t> m_commandData;
+
+    // FIFOs
+    std::vector<FifoEntry> m_txFifo;
+    std::vector<FifoEntry> m_rxFifo;
+    FifoEntry m_lastTransmitted;
+    bool m_reuseTX;
+
+    // CE and the PTX state machine
+    bool m_ce;
+    uint64_t m_ceHighTime;
+    uint64_t m_standbyReadyTime;
+    TxPhase m_txPhase;
+    uint64_t m_txEventTime;
+    uint64_t m_txStartTime;
+    uint8_t m_pid;
+    uint8_t m_arcCount;
+    uint8_t m_plosCount;
+    RFPacket m_packet;
+    bool m_ackReceived;
+    RFAck m_ack;
+    uint64_t m_ackTimeout;  // end of the ARD wait for m_ack
+
+    // PRX: the ACK going out, from the turnaround after a packet to its end
+    uint64_t m_ackEnd;
+    bool m_ackCut;
+
+    // PRX duplicate detection (per pipe)
+    int m_lastPid[6];
+    std::vector<uint8_t> m_lastPayload[6];
+
+    bool m_rpd;
+    uint64_t m_localTime;
+};
+
+class RFMedium
+{
+public:
+    RFMedium();
+
+    void attach(Nrf24Model* radio);
+
+    // Probability that a packet or an ACK is lost in the air (deterministic PRNG).
+    void setLossRate(double lossRate, uint32_t seed);
+
+    // Something else on the band (e.g. Wi-Fi) busy on channels first..last for a 'duty'
+    // fraction of the time, in randomly placed INTERFERENCE_SLOT_NS slots. Packets and
+    // ACKs that overlap a busy slot are lost, and RPD sees it.
+    void addInterferer(uint8_t firstChannel, uint8_t lastChannel, double duty, uint32_t seed);
+    bool interfered(uint8_t channel, uint64_t start, uint64_t end) const;
+
+    // Received signal strength at both ends, for range. Packets and ACKs then see bit
+    // errors that grow as the signal nears the receiver's sensitivity for the data rate,
+    // so longer and faster packets are lost first.
+    void setSignal(double dBm, uint32_t seed);
+
+    uint64_t now() const { return m_now; }
+
+    // Run every radio up to 'now', in event order.
+    void advance(uint64_t now);
+    uint64_t nextEventTime() const;
+
+    // Called by a transmitting radio
+    void beginTransmission(Nrf24Model* from, uint8_t channel, uint64_t start, uint64_t end);
+    RFAck deliver(Nrf24Model* from, const RFPacket& pkt, uint64_t start);
+    bool ackLost(const RFPacket& pkt, int ackPayloadSize, uint64_t start, uint64_t end);
+
+    // Loses the ACK of any packet it returns true for, on top of the rest
+    std::function<bool(const RFPacket&)> m_loseAck;
+
+    static uint64_t airTime(const RFPacket& pkt);
+    static uint64_t ackAirTime(const RFPacket& pkt, int ackPayloadSize);
+
+private:
+    struct Transmission
+    {
+        Nrf24Model* from;
+        uint8_t channel;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct Interferer
+    {
+        uint8_t firstChannel;
+        uint8_t lastChannel;
+        uint32_t dutyThreshold;
+        uint32_t seed;
+    };
+
+    bool collided(Nrf24Model* from, uint8_t channel, uint64_t start, uint64_t end) const;
+    bool lose();
+    bool weakSignalLost(uint8_t dataRate, uint64_t bits);
+
+    std::vector<Nrf24Model*> m_radios;
+    std::vector<Transmission> m_transmissions;
+    std::vector<Interferer> m_interferers;
+    uint64_t m_now;
+    uint32_t m_lossThreshold;
+    uint32_t m_rng;
+    bool m_hasSignal;
+    double m_signalDbm;
+    uint32_t m_signalRng;
+};
+
+#endif // NRF24_MODEL_H
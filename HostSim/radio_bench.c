@@ -0,0 +1,73 @@
+// Radio command benchmark: runs each radio.c command on the host simulation a few times
+// and prints the MCU time it spends in SPI, in MCLK cycles per command. Replaces main.c
+// in the host build; radio_bench.sh builds it against two versions of radio.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "radio.h"
+
+// MCLK is 8 MHz
+#define BENCH_MCLK_CYCLE_NS 125ULL
+#define BENCH_ROUNDS        16
+
+static uint8_t g_payload[32];
+static uint8_t g_address[5] = {0xE7, 0xE7, 0xE7, 0xE7, 0xE7};
+
+static void readRegister()     { radioReadRegisterByte(RADIO_REG_RF_CH); }
+static void writeRegister()    { radioWriteRegisterByte(RADIO_REG_RF_CH, 2); }
+static void writeAddress()     { radioWriteRegister(RADIO_REG_TX_ADDR, g_address, sizeof(g_address)); }
+static void writeTXPayload6()  { radioWriteTXPayload(g_payload, 6); }
+static void writeTXPayload32() { radioWriteTXPayload(g_payload, 32); }
+static void readRXPayload6()   { radioReadRXPayload(g_payload, 6); }
+static void readRXPayload32()  { radioReadRXPayload(g_payload, 32); }
+static void readPayloadWidth() { radioGetRXPayloadWidth(); }
+static void flushTX()          { radioFlushTX(); }
+static void readStatus()       { radioReadStatus(); }
+
+typedef struct
+{
+    const char* name;
+    void (*command)(void);
+} BenchCommand;
+
+static const BenchCommand g_commands[] =
+{
+    {"R_REGISTER 1 byte",         readRegister},
+    {"W_REGISTER 1 byte",         writeRegister},
+    {"W_REGISTER 5 byte address", writeAddress},
+    {"W_TX_PAYLOAD 6 bytes",      writeTXPayload6},
+    {"W_TX_PAYLOAD 32 bytes",     writeTXPayload32},
+    {"R_RX_PAYLOAD 6 bytes",      readRXPayload6},
+    {"R_RX_PAYLOAD 32 bytes",     readRXPayload32},
+    {"R_RX_PL_WID",               readPayloadWidth},
+    {"FLUSH_TX",                  flushTX},
+    {"NOP (status)",              readStatus},
+};
+
+static void benchInit()
+{
+    for (unsigned i = 0; i < sizeof(g_commands) / sizeof(g_commands[0]); ++i)
+    {
+        uint64_t spi = 0;
+        for (int round = 0; round < BENCH_ROUNDS; ++round)
+        {
+            uint64_t start = halHostSpiNanoseconds();
+            (g_commands[i].command)();
+            spi += halHostSpiNanoseconds() - start;
+
+            // Keep the TX FIFO from filling up; not counted
+            radioFlushTX();
+        }
+        printf("%-26s %6.1f\n", g_commands[i].name,
+               (double)spi / BENCH_ROUNDS / BENCH_MCLK_CYCLE_NS);
+    }
+    exit(0);
+}
+
+int main()
+{
+    halMain(&benchInit);
+    return 0;
+}
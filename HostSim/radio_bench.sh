@@ -0,0 +1,44 @@
+#!/bin/sh
+# Radio command benchmark: builds radio_bench.c with radio.c from a git revision (HEAD
+# by default) and from the working tree, both on the working tree's hal_host.c so the
+# two drivers are costed the same way, and prints the MCU time each radio command
+# spends in SPI, in MCLK cycles.
+#
+#   HostSim/radio_bench.sh [revision]
+#
+# e.g. HostSim/radio_bench.sh 9a7df58^ for the driver before the burst SPI transfers.
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/.." && pwd)
+rev=${1:-HEAD}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# build <radio.c source tree> <output binary>, with the Makefile
+build()
+{
+    obj=$(mktemp -d "$work/obj.XXXXXX")
+    make -s -C "$here" RADIO_SRC="$1" OUT="$obj" WARNINGS= radio_bench
+    cp "$obj/radio_bench" "$2"
+}
+
+mkdir "$work/rev"
+# Common/ only exists in later revisions
+git -C "$root" archive "$rev" $(git -C "$root" ls-tree --name-only "$rev" SegaGenController Common) |
+    tar -x -C "$work/rev"
+build "$work/rev" "$work/before"
+build "$root" "$work/after"
+
+"$work/before" </dev/null >"$work/before.txt"
+"$work/after" </dev/null >"$work/after.txt"
+
+printf "%-26s %10s %12s\n" "command" "$rev" "working tree"
+paste -d '\t' "$work/before.txt" "$work/after.txt" | awk -F '\t' '
+{
+    name = substr($1, 1, 26); sub(/ +$/, "", name)
+    before = substr($1, 27) + 0; after = substr($2, 27) + 0
+    printf "%-26s %10.1f %12.1f\n", name, before, after
+}'
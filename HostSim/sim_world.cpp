@@ -0,0 +1,539 @@
+#include "sim_world.h"
+#include "nrf24_model.h"
+#include "arduino_host.h"
+#include "../ArduinoRX/hal.h"
+#include "../Common/packet.h"
+#include "../Common/link_profile.h"
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_PER_US           1000ULL
+
+// Limit on back-to-back loop() calls at one instant, in case the sketch never clears the IRQ
+#define MAX_LOOPS_PER_EVENT 64
+
+// loop() also runs this often with no IRQ, standing in for the sketch spinning on it
+// (so its housekeeping, e.g. controller timeouts, sees time go by)
+#define IDLE_LOOP_NS        (1000 * NS_PER_US)
+
+// Supply current of the controller's parts, in uA (typical datasheet figures at 3 V).
+// MSP430G2553: I_AM is 330 uA per MHz of MCLK; LPM3 runs off the VLO, LPM4 stops it.
+#define MCU_ACTIVE_UA       (330.0 * 8)
+#define MCU_LPM3_UA         0.5
+#define MCU_LPM4_UA         0.1
+// Through a P2 pull-up (35 kOhm) into a pressed button
+#define MCU_PULLUP_UA       (3.0 / 35000 * 1e6)
+// nRF24L01+ (product spec table 9). RX and TX depend on RF_SETUP: see radioRxMicroamps()
+// and radioTxMicroamps().
+#define RADIO_POWER_DOWN_UA 0.9
+#define RADIO_STARTUP_UA    400.0   // average over the 1.5 ms crystal start-up
+#define RADIO_STANDBY_I_UA  26.0
+#define RADIO_STANDBY_II_UA 320.0
+#define RADIO_SETTLE_UA     8000.0  // TX settling
+
+#define NS_PER_HOUR         3600000000000.0
+
+// ArduinoRX.ino
+void setup();
+void loop();
+
+struct Latency
+{
+    uint32_t count;
+    uint64_t total;
+    uint64_t max;
+
+    void add(uint64_t value)
+    {
+        count++;
+        total += value;
+        if (value > max)
+        {
+            max = value;
+        }
+    }
+};
+
+class ReceiverBoard : public ArduinoHostBoard
+{
+public:
+    ReceiverBoard(Nrf24Model& radio) :
+        m_radio(radio), m_led(0), m_csn(HIGH), m_spiTransactions(0), m_profileJumpers(0) {}
+
+    virtual void pinWrite(uint8_t pin, uint8_t value)
+    {
+        if (pin == PIN_CSN)
+        {
+            if (m_csn != LOW && value == LOW)
+            {
+                m_spiTransactions++;
+            }
+            m_csn = value;
+            m_radio.setCSN(value != LOW);
+        }
+        else if (pin == PIN_CE)
+        {
+            m_radio.setLocalTime(arduinoHostNow());
+            m_radio.setCE(value != LOW);
+        }
+        else if (pin == PIN_LED)
+        {
+            m_led = value;
+        }
+    }
+
+    virtual int pinRead(uint8_t pin)
+    {
+        if (pin == PIN_IRQ)
+        {
+            return m_radio.irqAsserted() ? LOW : HIGH;
+        }
+        if (pin == PIN_PROFILE0 || pin == PIN_PROFILE1)
+        {
+            // Pulled up; a fitted jumper pulls the pin low
+            uint8_t bit = pin == PIN_PROFILE0 ? 1 : 2;
+            return (m_profileJumpers & bit) ? LOW : HIGH;
+        }
+        return LOW;
+    }
+
+    virtual uint8_t spiTransfer(uint8_t mosi)
+    {
+        m_radio.setLocalTime(arduinoHostNow());
+        return m_radio.spiTransfer(mosi);
+    }
+
+    uint32_t spiTransactions() const { return m_spiTransactions; }
+
+    void setProfileJumpers(uint8_t profile) { m_profileJumpers = profile; }
+    uint8_t profileJumpers() const { return m_profileJumpers; }
+
+private:
+    Nrf24Model& m_radio;
+    uint8_t m_led;
+    uint8_t m_csn;
+    uint32_t m_spiTransactions;
+    uint8_t m_profileJumpers;
+};
+
+static RFMedium g_medium;
+static Nrf24Model g_controllerRadio(g_medium, "controller");
+static Nrf24Model g_receiverRadio(g_medium, "receiver");
+static ReceiverBoard g_receiverBoard(g_receiverRadio);
+
+struct ButtonEdge
+{
+    uint64_t time;
+    uint8_t buttons;
+    bool wake;
+};
+
+static std::deque<ButtonEdge> g_pendingEdges;
+static uint64_t g_nextIdleLoop = 0;
+static bool g_receiverIrq = false;
+static uint32_t g_setupSpiTransactions = 0;
+static Latency g_edgeToAir;
+static Latency g_wakeToAir;
+static Latency g_edgeToReceiver;
+static Latency g_ageError;
+static uint32_t g_lostEdges = 0;
+static LinkTelemetry g_lastTelemetry;
+static uint32_t g_telemetryReports = 0;
+static double g_batteryMilliampHours = 0;
+static uint32_t g_hopConfirmAcksToLose = 0;
+
+static void runReceiver(uint64_t now)
+{
+    // IRQ pin edges go to the sketch's pin change interrupt, busy or not
+    if (g_receiverRadio.irqAsserted() != g_receiverIrq)
+    {
+        g_receiverIrq = !g_receiverIrq;
+        arduinoHostPinChange(PIN_IRQ, now);
+    }
+
+    // The sketch is still busy (e.g. blocked on Serial) from an earlier call
+    if (arduinoHostNow() > now)
+    {
+        return;
+    }
+
+    arduinoHostSetNow(now);
+
+    if (now >= g_nextIdleLoop)
+    {
+        g_nextIdleLoop = now + IDLE_LOOP_NS;
+        loop();
+    }
+
+    // loop() also drains the radio if the IRQ is still asserted. SPI accesses land on the radio at 'now'.
+    for (int i = 0; i < MAX_LOOPS_PER_EVENT && g_receiverRadio.irqAsserted() && arduinoHostNow() <= now; ++i)
+    {
+        loop();
+    }
+}
+
+void hostWorldInit()
+{
+    const char* serialPath = getenv("HOST_RX_SERIAL");
+    FILE* serialOut = serialPath ? fopen(serialPath, "wb") : 0;
+
+    arduinoHostAttach(&g_receiverBoard, serialOut);
+
+    g_medium.m_loseAck = [](const RFPacket& pkt)
+    {
+        uint8_t arg;
+        if (!g_hopConfirmAcksToLose || pkt.payload.size() < sizeof(StatePacket) ||
+            !statePacketExtensionOffset(&pkt.payload[0], (uint8_t)pkt.payload.size(), STATE_EXT_HOP_CONFIRM, &arg))
+        {
+            return false;
+        }
+        g_hopConfirmAcksToLose--;
+        return true;
+    };
+
+    g_receiverRadio.m_onReceive = [](const RFPacket& pkt, int /*pipe*/, uint64_t start)
+    {
+        if (pkt.payload.size() < sizeof(StatePacket))
+        {
+            return;
+        }
+
+        uint8_t telemetryOffset = statePacketTelemetryOffset(&pkt.payload[0], (uint8_t)pkt.payload.size());
+        if (telemetryOffset)
+        {
+            memcpy(&g_lastTelemetry, &pkt.payload[telemetryOffset], sizeof(g_lastTelemetry));
+            g_telemetryReports++;
+        }
+
+        // The newest pending edge this state answers, and any older ones it supersedes
+        StatePacket state;
+        memcpy(&state, &pkt.payload[0], sizeof(state));
+
+        size_t delivered = 0;
+        for (size_t i = 0; i < g_pendingEdges.size(); ++i)
+        {
+            if (g_pendingEdges[i].buttons == state.buttons && start >= g_pendingEdges[i].time)
+            {
+                delivered = i + 1;
+            }
+        }
+
+        // Where the receiver would put the press: the packet less the state's age
+        if (delivered)
+        {
+            uint64_t age = (uint64_t)state.age * 1000 * NS_PER_US / STATE_TICKS_PER_MILLI;
+            uint64_t edge = g_pendingEdges[delivered - 1].time;
+            if (state.age < STATE_AGE_MAX && start >= age + edge)
+            {
+                g_ageError.add(start - age - edge);
+            }
+        }
+
+        // The older ones made it only if the packet's history (STATE_EXT_HISTORY) has them
+        uint8_t historyCount = 0;
+        uint8_t historyOffset = statePacketHistoryOffset(&pkt.payload[0], (uint8_t)pkt.payload.size(),
+                                                         &historyCount);
+
+        for (size_t i = 0; i < delivered; ++i)
+        {
+            bool carried = i + 1 == delivered;
+            for (uint8_t j = 0; historyOffset && j < historyCount && !carried; ++j)
+            {
+                StateTransition change;
+                memcpy(&change, &pkt.payload[historyOffset + j * sizeof(change)], sizeof(change));
+                carried = change.buttons == g_pendingEdges.front().buttons;
+            }
+            if (!carried)
+            {
+                g_lostEdges++;
+            }
+
+            g_edgeToAir.add(start - g_pendingEdges.front().time);
+            if (g_pendingEdges.front().wake)
+            {
+                g_wakeToAir.add(start - g_pendingEdges.front().time);
+            }
+            g_edgeToReceiver.add(g_medium.now() - g_pendingEdges.front().time);
+            g_pendingEdges.pop_front();
+        }
+    };
+
+    // The sketch's own delays run ahead on its clock; the radio sees them at time 0
+    setup();
+    g_setupSpiTransactions = g_receiverBoard.spiTransactions();
+}
+
+int hostWorldConfigure(const char* line)
+{
+    double lossRate;
+    unsigned int seed = 1;
+    unsigned long baud;
+    unsigned int firstChannel, lastChannel;
+    double duty;
+    unsigned int profile;
+    double signal;
+    unsigned int count;
+
+    if (sscanf(line, " loss %lf %u", &lossRate, &seed) >= 1)
+    {
+        g_medium.setLossRate(lossRate, seed);
+        return 1;
+    }
+
+    if (sscanf(line, " interferer %u %u %lf %u", &firstChannel, &lastChannel, &duty, &seed) >= 3)
+    {
+        g_medium.addInterferer((uint8_t)firstChannel, (uint8_t)lastChannel, duty, seed);
+        return 1;
+    }
+
+    if (sscanf(line, " hopackloss %u", &count) == 1)
+    {
+        g_hopConfirmAcksToLose = count;
+        return 1;
+    }
+
+    if (sscanf(line, " rxprofile %u", &profile) == 1)
+    {
+        g_receiverBoard.setProfileJumpers((uint8_t)profile);
+        return 1;
+    }
+
+    if (sscanf(line, " signal %lf %u", &signal, &seed) >= 1)
+    {
+        g_medium.setSignal(signal, seed);
+        return 1;
+    }
+
+    if (sscanf(line, " battery %lf", &g_batteryMilliampHours) == 1)
+    {
+        return 1;
+    }
+
+    if (sscanf(line, " serial %lu", &baud) == 1)
+    {
+        arduinoHostSetSerialBaud(baud);
+        return 1;
+    }
+
+    return 0;
+}
+
+uint64_t hostWorldNextEventTime()
+{
+    uint64_t next = g_medium.nextEventTime();
+
+    // The idle loop() can't run until the sketch is done with whatever it's blocked on
+    uint64_t receiverFree = arduinoHostNow();
+    uint64_t idleLoop = g_nextIdleLoop > receiverFree ? g_nextIdleLoop : receiverFree;
+    if (idleLoop < next)
+    {
+        next = idleLoop;
+    }
+
+    // A busy receiver with work pending picks it up when it is done
+    if (g_receiverRadio.irqAsserted() && receiverFree > g_medium.now() && receiverFree < next)
+    {
+        next = receiverFree;
+    }
+
+    return next;
+}
+
+void hostWorldAdvance(uint64_t now)
+{
+    for (;;)
+    {
+        uint64_t next = hostWorldNextEventTime();
+        if (next > now)
+        {
+            break;
+        }
+
+        g_medium.advance(next);
+        runReceiver(next);
+    }
+
+    g_medium.advance(now);
+    runReceiver(now);
+}
+
+void hostWorldButtonEdge(uint64_t time, uint8_t buttons, int wake)
+{
+    g_pendingEdges.push_back({time, buttons, wake != 0});
+}
+
+static void printLatency(const char* label, const Latency& latency)
+{
+    if (latency.count)
+    {
+        printf("%-19s%lu edges, mean %.1f us, max %.1f us\n", label,
+               (unsigned long)latency.count,
+               (double)latency.total / latency.count / NS_PER_US,
+               (double)latency.max / NS_PER_US);
+    }
+}
+
+// The receiver's profile, with the air times from link_profile.h
+static void printLinkProfile()
+{
+    static const LinkProfile profiles[LINK_PROFILE_COUNT] = LINK_PROFILES;
+    uint8_t index = g_receiverBoard.profileJumpers();
+    const LinkProfile* p = &profiles[index < LINK_PROFILE_COUNT ? index : LINK_PROFILE_STANDARD];
+
+    // Not CONFIG: the controller may be asleep, with the radio powered down
+    bool match = g_controllerRadio.reg(0x06) == p->rfSetup &&
+                 g_controllerRadio.reg(0x03) == LINK_PROFILE_SETUP_AW(p) &&
+                 g_controllerRadio.reg(0x04) == LINK_PROFILE_SETUP_RETR(p);
+
+    printf("link profile:      %u: %u kbps, %u-byte CRC, %u-byte addresses, ARD %u us, ARC %u%s\n",
+           index, linkProfileKbps(p), p->crcLength, p->addressWidth, (p->ard + 1) * 250, p->arc,
+           match ? "" : " (controller doesn't match)");
+    printf("link air time:     state packet %u us, ACK %u us, round trip %u us\n",
+           linkProfileAirMicros(p, sizeof(StatePacket)), linkProfileAirMicros(p, sizeof(AckPacket)),
+           linkProfileRoundTripMicros(p, sizeof(StatePacket), sizeof(AckPacket)));
+}
+
+static double radioRxMicroamps(uint8_t rfSetup)
+{
+    return (rfSetup & LINK_RF_250KBPS) ? 12600.0 : (rfSetup & LINK_RF_2MBPS) ? 13500.0 : 13100.0;
+}
+
+// RF_PWR: -18, -12, -6, 0 dBm
+static double radioTxMicroamps(uint8_t rfSetup)
+{
+    static const double current[4] = { 7000.0, 7500.0, 9000.0, 11300.0 };
+    return current[(rfSetup >> 1) & 3];
+}
+
+// uAh drawn over 'ns' at 'microamps'
+static double microampHours(uint64_t ns, double microamps)
+{
+    return microamps * ns / NS_PER_HOUR;
+}
+
+// The controller's charge use, part by part, at the RF_SETUP it ended up with
+static void printEnergy(const HostCpuTime* cpu)
+{
+    const Nrf24Model& r = g_controllerRadio;
+    uint8_t rfSetup = r.reg(0x06);
+
+    double spi = microampHours(cpu->spi, MCU_ACTIVE_UA);
+    double active = microampHours(cpu->active - cpu->spi, MCU_ACTIVE_UA);
+    double lpm3 = microampHours(cpu->total - cpu->active - cpu->lpm4, MCU_LPM3_UA);
+    double lpm4 = microampHours(cpu->lpm4, MCU_LPM4_UA);
+    double pullups = microampHours(cpu->pullupButtons, MCU_PULLUP_UA);
+
+    double tx = microampHours(r.m_statTxTime, radioTxMicroamps(rfSetup));
+    double rx = microampHours(r.m_statRxTime, radioRxMicroamps(rfSetup));
+    double settle = microampHours(r.m_statSettleTime, RADIO_SETTLE_UA);
+    double standby = microampHours(r.m_statStartupTime, RADIO_STARTUP_UA) +
+                     microampHours(r.m_statStandbyTime, RADIO_STANDBY_I_UA) +
+                     microampHours(r.m_statStandbyIITime, RADIO_STANDBY_II_UA);
+    double powerDown = microampHours(r.m_statPowerDownTime, RADIO_POWER_DOWN_UA);
+
+    double mcu = spi + active + lpm3 + lpm4 + pullups;
+    double radio = tx + rx + settle + standby + powerDown;
+    double total = mcu + radio;
+
+    printf("charge:            %.3f uAh: MCU %.3f (active %.3f, SPI %.3f, LPM3 %.3f, LPM4 %.3f, "
+           "key pull-ups %.3f), radio %.3f (TX %.3f, RX %.3f, settle %.3f, standby %.3f, power down %.3f)\n",
+           total, mcu, active, spi, lpm3, lpm4, pullups, radio, tx, rx, settle, standby, powerDown);
+
+    if (!cpu->total)
+    {
+        return;
+    }
+
+    // uAh over the run -> average mA, i.e. mAh per hour
+    double milliampHoursPerHour = total / 1000.0 * NS_PER_HOUR / cpu->total;
+    printf("average current:   %.4f mA (%.4f mAh per hour)", milliampHoursPerHour,
+           milliampHoursPerHour);
+    if (g_batteryMilliampHours > 0)
+    {
+        double hours = g_batteryMilliampHours / milliampHoursPerHour;
+        printf(", %.1f days on %.0f mAh", hours / 24, g_batteryMilliampHours);
+    }
+    printf("\n");
+}
+
+void hostWorldReport(const HostCpuTime* cpu)
+{
+    printLinkProfile();
+    printf("radio packets:     %lu transmissions, %lu acked, %lu MAX_RT, %.1f us on air\n",
+           (unsigned long)g_controllerRadio.m_statTransmissions,
+           (unsigned long)g_controllerRadio.m_statPacketsAcked,
+           (unsigned long)g_controllerRadio.m_statMaxRT,
+           (double)g_controllerRadio.m_statAirTime / NS_PER_US);
+    printf("radio channel:     controller %u, receiver %u\n",
+           g_controllerRadio.channel(), g_receiverRadio.channel());
+    if (g_controllerRadio.m_statWakes)
+    {
+        uint32_t wakes = g_controllerRadio.m_statWakes;
+        printf("radio wakes:       %lu from power-down, %.1f SPI transactions to the first send, at most %lu\n",
+               (unsigned long)wakes, (double)g_controllerRadio.m_statWakeTransactions / wakes,
+               (unsigned long)g_controllerRadio.m_statMaxWakeTransactions);
+    }
+    printf("radio time:        TX %.1f us, RX %.1f us, settle %.1f us, start-up %.1f us, "
+           "standby-II %.1f us, standby-I %.1f us, power down %.1f us\n",
+           (double)g_controllerRadio.m_statTxTime / NS_PER_US,
+           (double)g_controllerRadio.m_statRxTime / NS_PER_US,
+           (double)g_controllerRadio.m_statSettleTime / NS_PER_US,
+           (double)g_controllerRadio.m_statStartupTime / NS_PER_US,
+           (double)g_controllerRadio.m_statStandbyIITime / NS_PER_US,
+           (double)g_controllerRadio.m_statStandbyTime / NS_PER_US,
+           (double)g_controllerRadio.m_statPowerDownTime / NS_PER_US);
+    printf("receiver:          %lu packets, %lu dropped on a full RX FIFO, %lu serial bytes\n",
+           (unsigned long)g_receiverRadio.m_statReceived,
+           (unsigned long)g_receiverRadio.m_statRxFifoFull,
+           (unsigned long)arduinoHostSerialBytes());
+
+    // Not counting setup(): the rest is draining the radio and loading ACK payloads
+    uint32_t received = g_receiverRadio.m_statReceived;
+    uint32_t transactions = g_receiverBoard.spiTransactions() - g_setupSpiTransactions;
+    printf("receiver SPI:      %lu transactions after setup, %.2f per packet received\n",
+           (unsigned long)transactions, received ? (double)transactions / received : 0.0);
+
+    const ArduinoHostIOStats& io = arduinoHostIOStats();
+    printf("receiver I/O:      %lu SPI setups, %lu SPI bytes, %lu digital I/O, %lu port writes, %.1f us in ISRs\n",
+           (unsigned long)io.spiSetups, (unsigned long)io.spiBytes, (unsigned long)io.digitalIO,
+           (unsigned long)io.portWrites, (double)io.isrTime / NS_PER_US);
+    if (g_telemetryReports)
+    {
+        const LinkTelemetry& t = g_lastTelemetry;
+        printf("telemetry:         %lu received; last: sent %u, acked %u, MAX_RT %u, PLOS %u, ARC %u, "
+               "backoff %u ms, keepalives %u, wakes %u\n",
+               (unsigned long)g_telemetryReports, t.sent, t.acked, t.maxRT, t.plos, t.arc,
+               t.backoffMillis, t.keepalives, t.wakes);
+    }
+    printLatency("edge to air:", g_edgeToAir);
+    if (g_edgeToAir.count)
+    {
+        printf("edges lost:        %lu superseded before a packet carried them\n", (unsigned long)g_lostEdges);
+    }
+    printLatency("wake to air:", g_wakeToAir);
+    printLatency("edge to receiver:", g_edgeToReceiver);
+    printLatency("edge from age:", g_ageError);
+    printEnergy(cpu);
+}
+
+void hostRadioSetCSN(int high)
+{
+    g_controllerRadio.setCSN(high != 0);
+}
+
+uint8_t hostRadioSpiTransfer(uint8_t mosi)
+{
+    return g_controllerRadio.spiTransfer(mosi);
+}
+
+void hostRadioSetCE(int high)
+{
+    g_controllerRadio.setCE(high != 0);
+}
+
+int hostRadioIRQ()
+{
+    return g_controllerRadio.irqAsserted();
+}
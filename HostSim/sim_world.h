@@ -0,0 +1,53 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+// Everything outside the controller's MSP430: its nRF24L01+, the RF medium, and an
+// ArduinoRX receiver (sketch + nRF24L01+) on the other end. hal_host.c owns the
+// virtual clock and drives this through the functions below.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hostWorldInit();
+
+// Returns nonzero if the script line was a world setting, e.g. "loss 0.1 [seed]"
+int hostWorldConfigure(const char* line);
+
+uint64_t hostWorldNextEventTime();
+void hostWorldAdvance(uint64_t now);
+
+// A scripted button edge on the controller, for end-to-end latency: the edge counts as
+// delivered when a state packet with these buttons (or a later state) is received.
+// 'wake' is set for a press that wakes the controller from sleep (halSetKeyWake).
+void hostWorldButtonEdge(uint64_t time, uint8_t buttons, int wake);
+
+// The controller MCU's time, in ns: all of it, awake (of that, the time spent on SPI
+// transfers) and in LPM4 (the rest is LPM3). pullupButtons is the time the key pull-ups were on,
+// times the buttons held down (each draws current through its pull-up).
+typedef struct
+{
+    uint64_t total;
+    uint64_t active;
+    uint64_t lpm4;
+    uint64_t spi;
+    uint64_t pullupButtons;
+} HostCpuTime;
+
+// Prints the world's statistics, and the controller's charge use from 'cpu' and its
+// radio's power states
+void hostWorldReport(const HostCpuTime* cpu);
+
+// The controller's radio pins
+void hostRadioSetCSN(int high);
+uint8_t hostRadioSpiTransfer(uint8_t mosi);
+void hostRadioSetCE(int high);
+int hostRadioIRQ();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_WORLD_H
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Sleep tier benchmark: builds the host simulation from the working tree once for each
+# standby window (SLEEP_STANDBY_MILLIS in sleep.c) and runs a usage profile on each.
+# Prints the controller's average current against how long the presses that woke it
+# took to get on the air.
+#
+#   HostSim/sleep_tier_bench.sh [profile]
+#
+# The profile defaults to profiles/pauses.txt. Pass other windows with
+# TIERS="0 500 5000".
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+profile=${1:-"$here/profiles/pauses.txt"}
+tiers=${TIERS:-"0 500 1000 2000 5000 15000 60000"}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# build <standby millis> <output binary>, with the Makefile
+build()
+{
+    obj=$(mktemp -d "$work/obj.XXXXXX")
+    make -s -C "$here" OUT="$obj" WARNINGS= DEFINES="-DSLEEP_STANDBY_MILLIS=$1"
+    cp "$obj/segagen-host" "$2"
+}
+
+printf "%-12s %12s %8s %16s %16s\n" "standby ms" "mA" "wakes" "wake to air us" "max us"
+for tier in $tiers
+do
+    build "$tier" "$work/host"
+    "$work/host" < "$profile" | awk -v tier="$tier" '
+        /^average current:/ { current = $3 }
+        /^wake to air:/ { wakes = $4; mean = $7; max = $10 }
+        END {
+            printf "%-12s %12s %8s %16s %16s\n", tier, current, wakes ? wakes : 0,
+                   wakes ? mean : "-", wakes ? max : "-"
+        }'
+done
@@ -3,106 +3,386 @@
 #include "hal.h"
 #include "radio.h"
 #include "sleep.h"
+#include "../Common/packet.h"
+#include "../Common/link.h"
+#include "../Common/link_profile.h"
 #include <string.h>
 
 #define AWAKE_STATE_IDLE          0
 #define AWAKE_STATE_SENDING       1
 #define AWAKE_STATE_WAIT          2
+#define AWAKE_STATE_POWERUP       3
+
+// Radio power down -> standby transition (Tpd2stby) w/ a good margin
+#define RADIO_POWERUP_MILLIS      5
+
+// Send the current state anyway after this long idle
+#define KEEPALIVE_MILLIS          1000
+
+// LinkTelemetry goes with the next packet at least this often, busy or not
+#define TELEMETRY_MILLIS          2000
+
+// State packets in a row that may carry a history instead of telemetry that's due
+#define TELEMETRY_MAX_DEFERRALS   8
+
+// Packets we can have queued in the radio at once
+#define TX_FIFO_DEPTH             3
+
+// Channel hopping (see link.h)
+#define HOP_NONE                  0
+#define HOP_REQUESTING            1   // sending STATE_EXT_HOP_REQUEST
+#define HOP_CONFIRMING            2   // told where to go; confirm once the FIFO is empty
+#define HOP_SWITCHING             3   // confirm in flight; move when it's ACKed or fails
+#define HOP_SETTLING              4   // moved; wait for the receiver to follow
+
+// Packets sent between looks at OBSERVE_TX
+#define LINK_QUALITY_WINDOW       16
+
+// Tries lost out of a window that make us ask for another channel
+#define HOP_LOSS_THRESHOLD        4
+
+// Failures without an ACK in between before we assume the receiver is on another
+// channel and go looking, one channel per failure
+#define SCAN_AFTER_FAILURES       6
+
+// Time for the receiver to get its ACK out and follow us to the new channel
+#define HOP_SETTLE_MILLIS         1
+
+// Key changes kept for STATE_EXT_HISTORY: the current state and the ones before it
+#define HISTORY_LENGTH            (STATE_HISTORY_MAX + 1)
+
+// Nothing is acknowledged on a burst profile, so changes go along for this long instead
+#define HISTORY_BURST_MILLIS      100
+
+#define TRANSITION_UNSENT         0
+#define TRANSITION_SENT           1   // as packet seq, and maybe later ones
+#define TRANSITION_ACKED          2   // a packet carrying it was ACKed
+
+typedef struct
+{
+    HalTime time;               // when the key poll saw it
+    uint8_t buttons;
+    uint8_t seq;
+    uint8_t state;
+} Transition;
 
 typedef struct
 {
-    uint16_t stateMillis;
     uint16_t waitTime;
     uint8_t buttonState;
-    uint8_t inFlightState;
+    HalTime buttonTime;         // when the key poll saw buttonState
+    uint8_t nextSeq;
+    // Packets in the TX FIFO, oldest (the one on air) first
+    uint8_t inFlightCount;
+    StatePacket inFlight[TX_FIFO_DEPTH];
     uint8_t receiverButtonState;
     uint8_t receiverButtonStateValid;
     uint8_t state;
     uint8_t consecutiveSendFailures;
     uint16_t secondsInactive;
+    uint8_t failuresSinceAck;   // unlike consecutiveSendFailures, not reset by new states
+    uint8_t retries;            // the link profile's ARC: tries the radio adds to each send
+    uint8_t copies;             // the link profile's NOACK copies of each state, 0 for ACKs
+    uint8_t windowSent;
+    uint8_t windowRetries;      // ... and how many it has needed this window
+    uint8_t hopState;
+    uint8_t hopChannel;
+    uint8_t hopConfirmSeq;
+    uint8_t telemetryDue;       // send LinkTelemetry with the next packet
+    uint8_t telemetryInFlight;  // ... and it has gone, as packet telemetrySeq
+    uint8_t telemetrySeq;
+    uint8_t telemetryDeferred;  // packets that carried a history while it was due
+    // Key changes, oldest first; the last is the current state
+    uint8_t historyCount;
+    Transition history[HISTORY_LENGTH];
 } AwakeState;
 
 static AwakeState g_awakeState;
+static LinkStats g_linkStats = {.minRoundTrip = 0xFFFF};
+
+static const uint8_t g_channels[LINK_CHANNEL_COUNT] = LINK_CHANNELS;
+static const LinkProfile g_linkProfiles[LINK_PROFILE_COUNT] = LINK_PROFILES;
+
+static int awakeMode_stateTimeout();
 
-static void radioWake()
+// Each state has at most one timeout pending: the end of power-up, the keepalive
+// while idle, or the end of the backoff wait.
+static void setState(uint8_t state, uint16_t timeoutMillis)
 {
-    // CONFIG register
-    // 7 Reserved       = 0
-    // 6 MASK_RX_DR     = 0: enable RX interrupt
-    // 5 MASK_TX_DR     = 0: enable TX complete interrupt
-    // 4 MASK_MAX_RT    = 0: enable TX max retries interrupt
-    // 3 EN_CRC         = 1: enable CRC
-    // 2 CRC0           = 1: 2-byte CRC
-    // 1 PWR_UP         = 1: power up
-    // 0 PRIM_RX        = 0: primary TX
-    radioWriteRegisterByte(RADIO_REG_CONFIG, BIT3 | BIT2 | BIT1);
-
-    // Enable auto ack on pipes 0,1
-    radioWriteRegisterByte(RADIO_REG_EN_AA, BIT1 | BIT0);
-
-    // Enable receive on pipes 0,1
-    radioWriteRegisterByte(RADIO_REG_EN_RXADDR, BIT1 | BIT0);
-
-    // Set address width to 3 bytes
-    radioWriteRegisterByte(RADIO_REG_SETUP_AW, 1);
-
-    // Auto retransmit delay - 250 usec RX mode (MSByte=0), 0 auto retransmit (LSByte=0)
-    radioWriteRegisterByte(RADIO_REG_SETUP_RETR, 0x00);
-
-    // Set RF channel to 2403 MHz
-    radioWriteRegisterByte(RADIO_REG_RF_CH, 3);
-
-    // RF_SETUP
-    // 7   CONT_WAVE    = 0: Continuous carrier transmit off (we are not in test mode)
-    // 6   Reserved     = 0:
-    // 5   RF_DR_LOW    = 0: With RF_DR_HIGH, set 1 Mbps rate
-    // 4   PLL_LOCK     = 0: Do not force PLL lock (we are not in test mode)
-    // 3   RF_DR_HIGH   = 0: With RF_DR_LOW, set 1 Mbps rate
-    // 2:1 RF_PWR       = 11: 0 dBm
-    // 0   Obsolete     = 0: (don't care)
-    radioWriteRegisterByte(RADIO_REG_RF_SETUP, BIT2 | BIT1);
-
-    uint8_t destAddr[] = {0xE7, 0xE7, 0xE7};
-    uint8_t srcAddr[] = {0xC2, 0xC2, 0xC2};
-
-    // Set TX/RX addresses. We must receive on the address we send to for auto-ACK to work.
-    radioWriteRegister(RADIO_REG_RX_ADDR_P0, destAddr, sizeof(destAddr));
-    radioWriteRegister(RADIO_REG_RX_ADDR_P1, srcAddr, sizeof(srcAddr));
-    radioWriteRegister(RADIO_REG_TX_ADDR, destAddr, sizeof(destAddr));
-
-    //radioWriteRegisterByte(RADIO_REG_RX_PW_P0, 32);
-
-    // Enable dynamic payload length on pipes 0,1
-    radioWriteRegisterByte(RADIO_REG_DYNPD, BIT1 | BIT0);
-
-    // FEATURE
-    // 2 EN_DPL         = 1: Enable dynamic payload length
-    // 1 EN_ACK_PAY     = 0: Disable ACK payload
-    // 0 EN_DYN_ACK     = 0: Don't need to send TX w/o ACK
-    radioWriteRegisterByte(RADIO_REG_FEATURE, BIT2);
-
-    // Clear all queues and clear interrupt bits
-    radioFlushTX();
-    radioFlushRX();
-    radioWriteRegisterByte(RADIO_REG_STATUS, BIT6 | BIT5 | BIT4);
-
-    // Allow radio a good time to power up
-    // (Tpd2stby)
-    halDelayMicroseconds(5000UL);
+    g_awakeState.state = state;
+
+    cancelTask(&awakeMode_stateTimeout);
+    if (timeoutMillis)
+    {
+        addTimer(&awakeMode_stateTimeout, timeoutMillis);
+    }
 }
 
+// Which of the receiver's pipes we talk to, from DIP switches 0 and 1 (see link.h)
+static uint8_t readUnit()
+{
+    return LINK_DIP_UNIT(halReadDIP());
+}
+
+// Which link profile, from DIP switches 2 and 3 (see link_profile.h)
+static const LinkProfile* readLinkProfile()
+{
+    uint8_t profile = LINK_DIP_PROFILE(halReadDIP());
+    return &g_linkProfiles[profile < LINK_PROFILE_COUNT ? profile : LINK_PROFILE_STANDARD];
+}
+
+// Returns nonzero if the radio was still powered up (sleep mode's standby tier), so it
+// can transmit straight away.
+static int radioWake(uint8_t unit, const LinkProfile* profile)
+{
+    // The radio keeps its registers through power-down, so most of the writes below
+    // are skipped by the shadow. RF_CH is never left at its reset value (2 isn't one of
+    // LINK_CHANNELS), so if it doesn't read back as we set it the radio has been reset
+    // behind our back and nothing in the shadow can be trusted.
+    if (!radioCheckShadow(RADIO_REG_RF_CH))
+    {
+        // Clear all queues and clear interrupt bits
+        // (radioSleep() already did this if the radio kept its state)
+        radioFlushTX();
+        radioFlushRX();
+        radioWriteRegisterByte(RADIO_REG_STATUS, BIT6 | BIT5 | BIT4);
+    }
+
+    // PWR_UP, before the writes below set it. With nothing in the shadow the radio has
+    // been reset (or not set up since power-on), which leaves it powered down.
+    uint8_t config;
+    int poweredUp = radioGetShadowedRegisterByte(RADIO_REG_CONFIG, &config) && (config & BIT1);
+
+    // Everything that has to match the receiver (see radio_init.h). RF channel:
+    // wherever we last found the receiver (LINK_CHANNELS[0] at first).
+    const RadioRegisterInit init[LINK_RADIO_INIT_COUNT] =
+        LINK_RADIO_INIT(profile, g_channels[g_linkStats.channel], BIT0, LINK_RADIO_PTX);
+    radioSetRegisters(init, LINK_RADIO_INIT_COUNT);
+
+    // Set TX/RX addresses: our unit's address on the receiver. We must receive on the
+    // address we send to for auto-ACK to work.
+    uint8_t destAddr[LINK_ADDRESS_MAX_WIDTH];
+    linkUnitAddress(unit, destAddr);
+    radioSetRegister(RADIO_REG_RX_ADDR_P0, destAddr, profile->addressWidth);
+    radioSetRegister(RADIO_REG_TX_ADDR, destAddr, profile->addressWidth);
+
+    // From power-down the radio needs Tpd2stby before it can transmit; the POWERUP state
+    // times out once that has passed.
+    return poweredUp;
+}
+
+// Read OBSERVE_TX into the telemetry totals. Returns PLOS_CNT, the packets lost (MAX_RT)
+// since RF_CH was last written.
+static uint8_t readObserveTX()
+{
+    uint8_t observe = radioReadRegisterByte(RADIO_REG_OBSERVE_TX);
+    g_linkStats.telemetry.plos += observe >> 4;
+    return observe >> 4;
+}
+
+// Retransmits the radio made by itself. OBSERVE_TX's ARC_CNT only holds the last
+// packet's, so they're counted packet by packet.
+static void countRetries(uint8_t retries)
+{
+    g_linkStats.telemetry.arc += retries;
+    g_awakeState.windowRetries = g_awakeState.windowRetries + retries > 255 ? 255 :
+                                 g_awakeState.windowRetries + retries;
+}
+
+static void setChannel(uint8_t channel)
+{
+    halSetRadioCE(0);
+
+    // Writing RF_CH restarts PLOS_CNT, so count what it has first
+    if (channel != g_linkStats.channel)
+    {
+        readObserveTX();
+    }
+    g_linkStats.channel = channel;
+
+    radioSetRegisterByte(RADIO_REG_RF_CH, g_channels[channel]);
+    g_awakeState.windowSent = 0;
+    g_awakeState.windowRetries = 0;
+}
+
+// Every LINK_QUALITY_WINDOW packets, ask for a hop if too many tries were lost: the
+// packets lost outright, and the ones the radio had to retransmit. Only called with
+// nothing in flight, so RF_CH isn't touched mid-transmission.
+static void checkLinkQuality()
+{
+    if (g_awakeState.windowSent < LINK_QUALITY_WINDOW)
+    {
+        return;
+    }
+    g_awakeState.windowSent = 0;
+
+    // Then restart PLOS_CNT for the next window
+    uint8_t lost = readObserveTX();
+    lost = lost + g_awakeState.windowRetries > 255 ? 255 : lost + g_awakeState.windowRetries;
+    g_awakeState.windowRetries = 0;
+    radioWriteRegisterByte(RADIO_REG_RF_CH, g_channels[g_linkStats.channel]);
+
+    if (lost >= HOP_LOSS_THRESHOLD && g_awakeState.hopState == HOP_NONE)
+    {
+        g_awakeState.hopState = HOP_REQUESTING;
+    }
+    else if (lost < HOP_LOSS_THRESHOLD && g_awakeState.hopState == HOP_REQUESTING)
+    {
+        // Cleared up before the receiver found us anywhere better
+        g_awakeState.hopState = HOP_NONE;
+    }
+}
+
+// The key poll saw a change: add it to the history, dropping the oldest if it's full
+static void recordTransition()
+{
+    if (g_awakeState.historyCount == HISTORY_LENGTH)
+    {
+        g_awakeState.historyCount--;
+        memmove(&g_awakeState.history[0], &g_awakeState.history[1],
+                g_awakeState.historyCount * sizeof(Transition));
+    }
+
+    Transition* t = &g_awakeState.history[g_awakeState.historyCount++];
+    t->time = g_awakeState.buttonTime;
+    t->buttons = g_awakeState.buttonState;
+    t->state = TRANSITION_UNSENT;
+}
+
+// Write the StateTransitions packet 'seq' carries to 'dest': the changes before the
+// current state that no ACK has covered, or on a burst profile the recent ones. Returns
+// how many. Changes that haven't gone out yet go out as this packet. With dest 0 the
+// packet carries none of them, only the current state.
+static uint8_t writeHistory(uint8_t* dest, uint8_t seq, HalTime now)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < g_awakeState.historyCount; ++i)
+    {
+        Transition* t = &g_awakeState.history[i];
+        int current = i + 1 == g_awakeState.historyCount;
+        if (!dest && !current)
+        {
+            continue;
+        }
+
+        if (t->state == TRANSITION_UNSENT)
+        {
+            t->state = TRANSITION_SENT;
+            t->seq = seq;
+        }
+
+        HalTime age = now - t->time;
+        int wanted = g_awakeState.copies ? age < halMillisToTicks(HISTORY_BURST_MILLIS) :
+                                           t->state != TRANSITION_ACKED;
+        if (!current && wanted)
+        {
+            StateTransition entry;
+            entry.seq = t->seq;
+            entry.buttons = t->buttons;
+            entry.age = age < STATE_AGE_MAX ? (uint16_t)age : STATE_AGE_MAX;
+            memcpy(&dest[count * sizeof(StateTransition)], &entry, sizeof(entry));
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Queue the current state behind whatever is already in flight. CE stays high while
+// anything is queued, so the radio sends the packets back to back. On a burst profile
+// it goes as that many NOACK copies, each with its own slot in the FIFO and inFlight.
 static void resendPacket()
 {
-    g_awakeState.state = AWAKE_STATE_SENDING;
-    g_awakeState.stateMillis = 0;
+    if (g_awakeState.inFlightCount == 0)
+    {
+        checkLinkQuality();
+    }
+    g_awakeState.windowSent++;
+
+    StatePacket* packet = &g_awakeState.inFlight[g_awakeState.inFlightCount++];
+    packet->seq = g_awakeState.nextSeq++;
+    packet->buttons = g_awakeState.buttonState;
+
+    HalTime now = halNow();
+    HalTime age = now - g_awakeState.buttonTime;
+    packet->time = (uint16_t)now;
+    packet->age = age < STATE_AGE_MAX ? (uint16_t)age : STATE_AGE_MAX;
+    g_linkStats.telemetry.sent++;
+
+    uint8_t payload[STATE_PACKET_MAX_SIZE];
+    uint8_t size = sizeof(StatePacket);
+    StateExtension* ext = (StateExtension*)&payload[sizeof(StatePacket)];
+    memcpy(payload, packet, sizeof(StatePacket));
+
+    if (g_awakeState.hopState == HOP_REQUESTING)
+    {
+        ext->type = STATE_EXT_HOP_REQUEST;
+        ext->arg = 0;
+        size += sizeof(StateExtension);
+        ext++;
+    }
+    else if (g_awakeState.hopState == HOP_CONFIRMING && g_awakeState.inFlightCount == 1)
+    {
+        // Nothing else queued, and nothing more until it's ACKed: we move straight after
+        ext->type = STATE_EXT_HOP_CONFIRM;
+        ext->arg = g_awakeState.hopChannel;
+        size += sizeof(StateExtension);
+        ext++;
+        g_awakeState.hopState = HOP_SWITCHING;
+        g_awakeState.hopConfirmSeq = packet->seq;
+    }
+
+    // Telemetry doesn't fit alongside a history; it waits for a packet without one, or
+    // takes this one and leaves the history to the next if it has waited long enough
+    int telemetryFirst = g_awakeState.telemetryDue &&
+                         g_awakeState.telemetryDeferred >= TELEMETRY_MAX_DEFERRALS;
+    uint8_t changes = writeHistory(telemetryFirst ? 0 : &payload[size + sizeof(StateExtension)],
+                                   packet->seq, now);
+    if (changes)
+    {
+        ext->type = STATE_EXT_HISTORY;
+        ext->arg = changes;
+        size += sizeof(StateExtension) + changes * sizeof(StateTransition);
+        if (g_awakeState.telemetryDue)
+        {
+            g_awakeState.telemetryDeferred++;
+        }
+    }
+    else if (g_awakeState.telemetryDue)
+    {
+        g_awakeState.telemetryDue = 0;
+        g_awakeState.telemetryDeferred = 0;
+        g_awakeState.telemetryInFlight = 1;
+        g_awakeState.telemetrySeq = packet->seq;
+        ext->type = STATE_EXT_TELEMETRY;
+        ext->arg = sizeof(LinkTelemetry);
+        size += sizeof(StateExtension);
+        memcpy(&payload[size], &g_linkStats.telemetry, sizeof(LinkTelemetry));
+        size += sizeof(LinkTelemetry);
+    }
 
     //P1OUT |= BIT6;
     halLedOn();
-    g_awakeState.inFlightState = g_awakeState.buttonState;
-    uint8_t buf[1] = {g_awakeState.buttonState};
+    if (g_awakeState.copies)
+    {
+        radioWriteTXPayloadNoACK(payload, size);
+        for (uint8_t i = 1; i < g_awakeState.copies; ++i)
+        {
+            g_awakeState.inFlight[g_awakeState.inFlightCount++] = *packet;
+            radioWriteTXPayloadNoACK(payload, size);
+        }
+    }
+    else
+    {
+        radioWriteTXPayload(payload, size);
+    }
 
-    radioWriteTXPayload(buf, sizeof(buf));
-    halPulseRadioCE();
+    if (g_awakeState.inFlightCount == (g_awakeState.copies ? g_awakeState.copies : 1))
+    {
+        setState(AWAKE_STATE_SENDING, 0);
+        halSetRadioCE(1);
+    }
 }
 
 static void sendPacket()
@@ -111,16 +391,63 @@ static void sendPacket()
     resendPacket();
 }
 
+// Is there room to queue another packet behind the ones in flight?
+static int canQueue()
+{
+    uint8_t slots = g_awakeState.copies ? g_awakeState.copies : 1;
+    return g_awakeState.inFlightCount + slots <= TX_FIFO_DEPTH &&
+           g_awakeState.hopState != HOP_SWITCHING;
+}
+
+// Does the receiver still need to hear about the current state? Compares against
+// the newest packet in flight, or what the receiver last acknowledged. Changes in
+// between count too, even if the buttons are back where they were.
+static int stateNeedsSending()
+{
+    for (uint8_t i = 0; i < g_awakeState.historyCount; ++i)
+    {
+        // Not sent yet, or flushed unacknowledged along with the packets that were
+        uint8_t state = g_awakeState.history[i].state;
+        if (state == TRANSITION_UNSENT || (state == TRANSITION_SENT && !g_awakeState.inFlightCount))
+        {
+            return 1;
+        }
+    }
+
+    if (g_awakeState.inFlightCount)
+    {
+        return g_awakeState.buttonState != g_awakeState.inFlight[g_awakeState.inFlightCount - 1].buttons;
+    }
+
+    return !g_awakeState.receiverButtonStateValid || g_awakeState.buttonState != g_awakeState.receiverButtonState;
+}
+
 static void awakeMode_onButtonChange()
 {
     g_awakeState.buttonState = halReadButtons();
+    g_awakeState.buttonTime = halReadButtonsTime();
+    recordTransition();
 
     g_awakeState.secondsInactive = 0;
 
-    if ((g_awakeState.state == AWAKE_STATE_IDLE || g_awakeState.state == AWAKE_STATE_WAIT) &&
-        (!g_awakeState.receiverButtonStateValid || g_awakeState.buttonState != g_awakeState.receiverButtonState))
+    if (g_awakeState.state == AWAKE_STATE_POWERUP)
     {
-        sendPacket();
+        // Goes out with the first packet
+        return;
+    }
+
+    // Don't wait for the packets in flight; queue behind them if there's room.
+    // If the FIFO is full, the newest state goes out when the next ACK frees a slot.
+    if (canQueue() && stateNeedsSending())
+    {
+        if (g_awakeState.state == AWAKE_STATE_WAIT)
+        {
+            sendPacket();
+        }
+        else
+        {
+            resendPacket();
+        }
     }
 
 //    if (g_awakeState.buttonState)
@@ -139,23 +466,43 @@ static void awakeMode_onTXFailed()
     // have received the packet but lost the ACK.
     g_awakeState.receiverButtonStateValid = 0;
 
-    if (g_awakeState.consecutiveSendFailures < 255)
+    // Send failures count tries: with ARC on, the radio has already made 1 + ARC of
+    // them, and gone through the fast retries below by itself. The scan counts MAX_RTs,
+    // as quick retries don't outlast an interferer's burst.
+    uint8_t tries = 1 + g_awakeState.retries;
+    uint8_t before = g_awakeState.consecutiveSendFailures;
+    g_awakeState.consecutiveSendFailures = before + tries > 255 ? 255 : before + tries;
+    if (g_awakeState.failuresSinceAck < 255)
     {
-        g_awakeState.consecutiveSendFailures++;
+        g_awakeState.failuresSinceAck++;
+    }
+
+    if (g_awakeState.hopState == HOP_SWITCHING)
+    {
+        // The confirm may have got through with only its ACK lost, so go anyway. If
+        // the receiver didn't get it, the scan below finds it again.
+        g_awakeState.hopState = HOP_NONE;
+        g_linkStats.hops++;
+        setChannel(g_awakeState.hopChannel);
+    }
+    else if (g_awakeState.failuresSinceAck >= SCAN_AFTER_FAILURES)
+    {
+        // Lost the receiver: try the next channel
+        setChannel((g_linkStats.channel + 1) % LINK_CHANNEL_COUNT);
     }
 
     if (g_awakeState.consecutiveSendFailures < 3)
     {
         resendPacket();
     }
-    else if (g_awakeState.consecutiveSendFailures == 3)
+    else if (before < 3)
     {
         g_awakeState.waitTime = 10;
 
-        g_awakeState.state = AWAKE_STATE_WAIT;
-        g_awakeState.stateMillis = 0;
+        setState(AWAKE_STATE_WAIT, g_awakeState.waitTime);
+        g_linkStats.telemetry.backoffMillis += g_awakeState.waitTime;
     }
-    else // > 3
+    else // already backing off
     {
         g_awakeState.waitTime += g_awakeState.waitTime;
         if (g_awakeState.waitTime > 1000)
@@ -163,50 +510,232 @@ static void awakeMode_onTXFailed()
             g_awakeState.waitTime = 1000;
         }
 
-        g_awakeState.state = AWAKE_STATE_WAIT;
-        g_awakeState.stateMillis = 0;
+        setState(AWAKE_STATE_WAIT, g_awakeState.waitTime);
+        g_linkStats.telemetry.backoffMillis += g_awakeState.waitTime;
     }
 }
 
-static void awakeMode_onTXSucceeded()
+// TX_DS: one or more of the packets in flight have been acknowledged, oldest first.
+// A NOACK copy raises TX_DS as soon as it's sent, so on a burst profile "acked" only
+// means "on the air".
+static void awakeMode_onTXAcked()
 {
-    g_awakeState.receiverButtonState = g_awakeState.inFlightState;
-    g_awakeState.receiverButtonStateValid = 1;
+    uint8_t acked = g_awakeState.inFlightCount ? 1 : 0;
 
-    if (!g_awakeState.receiverButtonStateValid || g_awakeState.buttonState != g_awakeState.receiverButtonState)
+    if (g_awakeState.inFlightCount > 1)
     {
-        sendPacket();
+        // TX_DS doesn't count, so see what's left in the FIFO. It only says empty or
+        // full; with three queued and one or two left, assume one was acked. If it was
+        // really two, the next TX_DS (or the FIFO emptying) catches up.
+        uint8_t fifoStatus = radioReadRegisterByte(RADIO_REG_FIFO_STATUS);
+        uint8_t left;
+
+        if (fifoStatus & BIT4)
+        {
+            left = 0;
+        }
+        else if (fifoStatus & BIT5)
+        {
+            left = TX_FIFO_DEPTH;
+        }
+        else
+        {
+            left = g_awakeState.inFlightCount == TX_FIFO_DEPTH ? 2 : 1;
+        }
+
+        acked = g_awakeState.inFlightCount > left ? g_awakeState.inFlightCount - left : 0;
     }
-    else
+
+    if (acked)
+    {
+        // The radio's retries for the newest (the others' are gone)
+        if (g_awakeState.retries)
+        {
+            countRetries(radioReadRegisterByte(RADIO_REG_OBSERVE_TX) & 0x0F);
+        }
+
+        // Only the newest of them was acked just now
+        if (!g_awakeState.copies)
+        {
+            uint16_t roundTrip = (uint16_t)halNow() - g_awakeState.inFlight[acked - 1].time;
+            g_linkStats.lastRoundTrip = roundTrip;
+            if (roundTrip < g_linkStats.minRoundTrip)
+            {
+                g_linkStats.minRoundTrip = roundTrip;
+            }
+            if (roundTrip > g_linkStats.maxRoundTrip)
+            {
+                g_linkStats.maxRoundTrip = roundTrip;
+            }
+            g_linkStats.roundTrips++;
+            g_linkStats.telemetry.acked += acked;
+        }
+
+        g_awakeState.receiverButtonState = g_awakeState.inFlight[acked - 1].buttons;
+        g_awakeState.receiverButtonStateValid = 1;
+
+        // ... and every change it or the packets before it carried
+        for (uint8_t i = 0; i < g_awakeState.historyCount; ++i)
+        {
+            Transition* t = &g_awakeState.history[i];
+            if (t->state == TRANSITION_SENT && (int8_t)(t->seq - g_awakeState.inFlight[acked - 1].seq) <= 0)
+            {
+                t->state = TRANSITION_ACKED;
+            }
+        }
+        g_awakeState.consecutiveSendFailures = 0;
+        g_awakeState.failuresSinceAck = 0;
+
+        // The confirm is the only packet in flight when it's sent
+        if (g_awakeState.hopState == HOP_SWITCHING &&
+            g_awakeState.inFlight[acked - 1].seq == g_awakeState.hopConfirmSeq)
+        {
+            g_awakeState.hopState = HOP_SETTLING;
+            g_linkStats.hops++;
+            setChannel(g_awakeState.hopChannel);
+        }
+
+        for (uint8_t i = 0; i < acked; ++i)
+        {
+            if (g_awakeState.inFlight[i].seq == g_awakeState.telemetrySeq)
+            {
+                g_awakeState.telemetryInFlight = 0;
+            }
+        }
+
+        g_awakeState.inFlightCount -= acked;
+        memmove(&g_awakeState.inFlight[0], &g_awakeState.inFlight[acked],
+                g_awakeState.inFlightCount * sizeof(StatePacket));
+    }
+}
+
+static void awakeMode_onAckPayload(const AckPacket* ack)
+{
+    g_linkStats.receiverSeq = ack->seq;
+    g_linkStats.receiverSeqValid = 1;
+    g_linkStats.receiverTime = ack->rxTime;
+
+    uint8_t arg = ACK_COMMAND_ARG(ack->command);
+
+    switch (ack->command & ACK_COMMAND_MASK)
+    {
+    case ACK_COMMAND_HOP:
+        // Repeated in every ACK until we get there; only the first one counts
+        if ((g_awakeState.hopState == HOP_NONE || g_awakeState.hopState == HOP_REQUESTING) &&
+            arg < LINK_CHANNEL_COUNT && arg != g_linkStats.channel)
+        {
+            g_awakeState.hopState = HOP_CONFIRMING;
+            g_awakeState.hopChannel = arg;
+        }
+        break;
+
+    case ACK_COMMAND_NONE:
+    default:
+        break;
+    }
+}
+
+// RX_DR: ACK payloads from the receiver. Several may be waiting if we've been streaming.
+static void awakeMode_readAckPayloads()
+{
+    do
     {
-        g_awakeState.state = AWAKE_STATE_IDLE;
-        g_awakeState.stateMillis = 0;
+        uint8_t size = radioGetRXPayloadWidth();
+        if (size != sizeof(AckPacket))
+        {
+            // Not ours (or a bad width): nothing in the FIFO is worth reading
+            radioFlushRX();
+            return;
+        }
+
+        AckPacket ack;
+        radioReadRXPayload((uint8_t*)&ack, sizeof(ack));
+        awakeMode_onAckPayload(&ack);
+    }
+    while (!(radioReadRegisterByte(RADIO_REG_FIFO_STATUS) & BIT0));
+}
+
+static void awakeMode_onTXSucceeded()
+{
+    if (g_awakeState.hopState == HOP_SETTLING)
+    {
+        // Just moved (CE is already low). The WAIT timeout sends the current state on
+        // the new channel, which also checks the receiver made it.
+        g_awakeState.hopState = HOP_NONE;
+        setState(AWAKE_STATE_WAIT, HOP_SETTLE_MILLIS);
+    }
+    else if (g_awakeState.inFlightCount == 0)
+    {
+        if (stateNeedsSending())
+        {
+            sendPacket();
+        }
+        else
+        {
+            //P1OUT &= ~BIT6;
+            halLedOff();
+
+            // Nothing queued: drop CE so the radio goes back to standby-I
+            halSetRadioCE(0);
+
+            setState(AWAKE_STATE_IDLE, KEEPALIVE_MILLIS);
+        }
+    }
+    else if (canQueue() && stateNeedsSending())
+    {
+        resendPacket();
     }
 }
 
 static void awakeMode_onRadioIRQ()
 {
-    //P1OUT &= ~BIT6;
-    halLedOff();
     uint8_t status = radioReadStatus();
 
+    // Sent successfully (TX_DS)
+    // Clear it before looking at the FIFO, so a packet that finishes in the
+    // meantime raises a new IRQ instead of being missed.
+    if (status & BIT5)
+    {
+        radioWriteRegisterByte(RADIO_REG_STATUS, BIT5);
+        awakeMode_onTXAcked();
+    }
+
+    // ACK payload(s) received (RX_DR)
+    if (status & BIT6)
+    {
+        radioWriteRegisterByte(RADIO_REG_STATUS, BIT6);
+        awakeMode_readAckPayloads();
+    }
+
     // Max retransmissions hit (MAX_RT)
     if (status & BIT4)
     {
-        // Flush TX buffer
+        //P1OUT &= ~BIT6;
+        halLedOff();
+
+        // Stop, and flush the failed packet along with everything queued behind it.
+        // Clearing MAX_RT with CE still high would send the failed packet again.
+        halSetRadioCE(0);
         radioFlushTX();
+        g_awakeState.inFlightCount = 0;
 
         // Clear all interrupt bits
         radioWriteRegisterByte(RADIO_REG_STATUS, BIT6 | BIT5 | BIT4);
 
+        g_linkStats.telemetry.maxRT++;
+        countRetries(g_awakeState.retries);
+
+        // The telemetry may have been flushed with the rest: send it again
+        if (g_awakeState.telemetryInFlight)
+        {
+            g_awakeState.telemetryInFlight = 0;
+            g_awakeState.telemetryDue = 1;
+        }
+
         awakeMode_onTXFailed();
     }
-    // Sent successfully (TX_DS)
     else if (status & BIT5)
     {
-        // Clear all interrupt bits
-        radioWriteRegisterByte(RADIO_REG_STATUS, BIT6 | BIT5 | BIT4);
-
         awakeMode_onTXSucceeded();
     }
     else
@@ -217,15 +746,22 @@ static void awakeMode_onRadioIRQ()
     }
 }
 
-static int awakeMode_timerTick()
+static int awakeMode_stateTimeout()
 {
-    g_awakeState.stateMillis += 10;
-
-    if (g_awakeState.state == AWAKE_STATE_IDLE && g_awakeState.stateMillis > 1000)
+    if (g_awakeState.state == AWAKE_STATE_POWERUP)
     {
+        // We probably came from sleep mode -- send a packet!
+        // Buttons pressed during power-up are already in buttonState.
         sendPacket();
     }
-    else if (g_awakeState.state == AWAKE_STATE_WAIT && g_awakeState.stateMillis >= g_awakeState.waitTime)
+    else if (g_awakeState.state == AWAKE_STATE_IDLE)
+    {
+        // Keepalive
+        g_linkStats.telemetry.keepalives++;
+        g_awakeState.telemetryDue = 1;
+        sendPacket();
+    }
+    else if (g_awakeState.state == AWAKE_STATE_WAIT)
     {
         resendPacket();
     }
@@ -247,25 +783,57 @@ static int awakeMode_inactivityTask()
     return 0;
 }
 
+// Keepalives and wakes send the telemetry too, but a steady stream of key changes
+// never leaves the link idle long enough for a keepalive
+static int awakeMode_telemetryTask()
+{
+    g_awakeState.telemetryDue = 1;
+    return 0;
+}
+
+const LinkStats* awakeMode_getLinkStats()
+{
+    return &g_linkStats;
+}
+
 void awakeMode_begin()
 {
     halBeginNoInterrupts();
 
     //P1OUT &= ~BIT6;
+    // seq carries on from the last awake period, so the receiver doesn't take our first
+    // packets for ones it has already seen
+    uint8_t nextSeq = g_awakeState.nextSeq;
     memset(&g_awakeState, 0, sizeof(g_awakeState));
+    g_awakeState.nextSeq = nextSeq;
     g_awakeState.buttonState = halReadButtons();
-    g_awakeState.state = AWAKE_STATE_IDLE;
+    g_awakeState.buttonTime = halReadButtonsTime();
+
+    // The first packet tells the receiver what happened while we were away
+    g_linkStats.telemetry.wakes++;
+    g_awakeState.telemetryDue = 1;
 
-    radioWake();
-    halSetTimerInterval(1, 10);
+    const LinkProfile* profile = readLinkProfile();
+    g_awakeState.retries = profile->arc;
+    g_awakeState.copies = profile->copies;
+
+    int ready = radioWake(readUnit(), profile);
+    halSetKeyPollInterval(1);
     halSetRadioIRQCallback(&awakeMode_onRadioIRQ);
     halSetButtonChangeCallback(&awakeMode_onButtonChange);
     clearTasks();
-    addTask(&awakeMode_timerTick, 10);
     addTask(&awakeMode_inactivityTask, 1000);
+    addTask(&awakeMode_telemetryTask, TELEMETRY_MILLIS);
 
-    // We probably came from sleep mode -- send a packet!
-    sendPacket();
+    if (ready)
+    {
+        sendPacket();
+    }
+    else
+    {
+        // Sleep in LPM3 through the radio power-up, polling keys as usual
+        setState(AWAKE_STATE_POWERUP, RADIO_POWERUP_MILLIS);
+    }
 
     halEndNoInterrupts();
 }
@@ -1,6 +1,33 @@
 #ifndef AWAKE_H
 #define AWAKE_H
 
+#include <stdint.h>
+#include "../Common/packet.h"
+
+// What we know about the link, from ACKs and the receiver's ACK payloads.
+// Kept across sleep; times are in HAL ticks.
+typedef struct
+{
+    // Queuing a state packet to its TX_DS
+    uint16_t lastRoundTrip;
+    uint16_t minRoundTrip;
+    uint16_t maxRoundTrip;
+    uint16_t roundTrips;
+
+    // The last AckPacket the receiver sent back
+    uint8_t receiverSeq;
+    uint8_t receiverSeqValid;
+    uint16_t receiverTime;
+
+    // Index into LINK_CHANNELS, and how many times we've moved
+    uint8_t channel;
+    uint8_t hops;
+
+    // Counters the receiver gets to see, too
+    LinkTelemetry telemetry;
+} LinkStats;
+
 void awakeMode_begin();
+const LinkStats* awakeMode_getLinkStats();
 
 #endif // AWAKE_H
@@ -18,21 +18,30 @@
 static volatile uint8_t g_interruptSource = 0;
 
 // Timer configuration
-static int g_timerDivider = 0;
-static int g_timerTickInterval = 0;
+// TIMER0_A runs continuously off ACLK. CCR0 paces the key polls, CCR1 is the deadline,
+// CCR2 samples the keys once the pull-ups have charged the pins.
+static uint16_t g_keyPollTicks = 0;
+static HalTime g_deadline = 0;
 
-// Timer tracking
-static int g_timerDivCounter = 0;
-static volatile uint16_t g_timerMillisCounter = 0;
+// Set by halSetKeyWake(): no key polls, P2 edges wake us instead
+static uint8_t g_keyWake = 0;
+
+// Set by the key sample when it saw a change and will look again on the next tick
+static uint8_t g_keyConfirm = 0;
+
+// Upper 16 bits of halNow(), counted by TAIFG
+static volatile uint16_t g_timeHigh = 0;
 
 // Key change detection
 // Goes along with an INT_SRC_BUTTON_CHANGE to notify us of what the IRQ saw
 static volatile uint8_t g_lastButtons = 0;
-// Our captured copy of this (updated once per "main thread" interrupt processing cycle)
+static volatile HalTime g_lastButtonsTime = 0;
+// Our captured copy of these (updated once per "main thread" interrupt processing cycle)
 static uint8_t g_lastButtonsCapture = 0;
+static HalTime g_lastButtonsTimeCapture = 0;
 
 // Callbacks to higher layer
-static TimerHandler g_timerCB = 0;
+static EventHandler g_deadlineCB = 0;
 static EventHandler g_radioIRQCB = 0;
 static EventHandler g_buttonsCB = 0;
 
@@ -140,10 +149,29 @@ static void spiInit()
     UCA0CTL1 &= ~UCSWRST;
 }
 
+static void timerInit()
+{
+    // Continuous mode off ACLK, with the overflow interrupt extending the count to 32 bits.
+    // Nothing is compared until halSetKeyPollInterval()/halSetDeadline().
+    TA0CCTL0 = 0;
+    TA0CCTL1 = 0;
+    TA0CCTL2 = 0;
+    TA0CTL = TASSEL_1 | ID_0 | MC_2 | TACLR | TAIE;
+}
+
 static void radioInit()
 {
-    // Radio power-on reset time: 100 ms w/ 25% extra tolerance
-    halDelayMicroseconds(125000);
+    // Radio power-on reset time: 100 ms w/ 25% extra tolerance.
+    // Sleep through it in LPM3 on the deadline timer instead of spinning at 8 MHz.
+    // Interrupts are still disabled here; _bis_SR_register enables them and sleeps
+    // in one step, so the timer interrupt can't slip in between.
+    halSetDeadline(halNow() + halMillisToTicks(125));
+    while (!(g_interruptSource & INT_SRC_TIMER))
+    {
+        _bis_SR_register(LPM3_bits | GIE);
+        __disable_interrupt();
+    }
+    g_interruptSource = 0;
 }
 
 #pragma vector=PORT1_VECTOR
@@ -162,11 +190,41 @@ __interrupt void PORT1_HOOK(void)
     CPU_ASLEEP;
 }
 
+#pragma vector=PORT2_VECTOR
+__interrupt void PORT2_HOOK(void)
+{
+    CPU_AWAKE;
+
+    // A button went down while we waited for one (halSetKeyWake). A pin that fell counts
+    // as pressed even if it has bounced back up by now; the buttons we didn't watch keep
+    // what the last poll saw.
+    uint8_t watched = P2IE;
+    uint8_t buttons = (g_lastButtons & ~watched) | ((uint8_t)(~P2IN | P2IFG) & watched);
+
+    // Back to pull-downs until the polls take over again
+    P2IE = 0;
+    P2IFG = 0;
+    P2OUT = 0x00;
+    g_keyWake = 0;
+
+    g_lastButtons = buttons;
+    g_lastButtonsTime = halNow();
+    g_interruptSource |= INT_SRC_BUTTON_CHANGE;
+    LPM4_EXIT;
+
+    CPU_ASLEEP;
+}
+
 uint8_t halReadButtons()
 {
     return g_lastButtonsCapture;
 }
 
+HalTime halReadButtonsTime()
+{
+    return g_lastButtonsTimeCapture;
+}
+
 uint8_t halReadDIP()
 {
     // Turn on pull-up registers
@@ -181,10 +239,10 @@ uint8_t halReadDIP()
     // Change pull-ups back to pull-downs
     P3OUT &= ~(BIT0 | BIT1 | BIT3 | BIT4);
 
-    // Compute final result.
-    // Must invert bits and then do some shifting.
+    // Compute final result: switch n in bit n.
+    // Must invert bits, then close the gap P3.2 (the LED) leaves.
     data = ~data;
-    return (data & 0b11) | ((data & 0b11000) >> 3);
+    return (data & 0b11) | ((data & 0b11000) >> 1);
 }
 
 uint16_t halReadBatteryVoltage()
@@ -193,37 +251,121 @@ uint16_t halReadBatteryVoltage()
     return 4200;
 }
 
-void halPulseRadioCE()
+void halSetRadioCE(int high)
 {
-    P1OUT |= BIT5;
-    halDelayMicroseconds(13); // 10us min pulse width + 25% buffer
-    // CE HIGH
-    P1OUT &= ~BIT5;
+    if (high)
+    {
+        P1OUT |= BIT5;
+    }
+    else
+    {
+        P1OUT &= ~BIT5;
+    }
 }
 
-void halSetTimerInterval(int keyPollInterval, int divider)
+static uint16_t readTimer()
+{
+    // TA0R counts on ACLK, which is asynchronous to MCLK, so a single read can
+    // catch it mid-update. Read until two reads agree.
+    uint16_t a, b;
+    do
+    {
+        a = TA0R;
+        b = TA0R;
+    } while (a != b);
+
+    return a;
+}
+
+HalTime halNow()
+{
+    halBeginNoInterrupts();
+
+    uint16_t high = g_timeHigh;
+    uint16_t low = readTimer();
+
+    // The counter wrapped but TAIFG hasn't been serviced yet
+    if ((TA0CTL & TAIFG) && low < 0x8000)
+    {
+        high++;
+    }
+
+    halEndNoInterrupts();
+
+    return ((HalTime)high << 16) | low;
+}
+
+void halSetKeyPollInterval(int keyPollInterval)
 {
     halBeginNoInterrupts();
 
-    g_timerDivider = divider;
-    g_timerDivCounter = divider;
-    g_timerTickInterval = keyPollInterval * divider;
+    // Stop waiting for edges, if we were
+    P2IE = 0;
+    P2IFG = 0;
+    P2OUT = 0x00;
+    g_keyWake = 0;
 
-    // Stop the timer, clear interrupt flag
-    TA0CTL &= ~(MC1 | MC0);
-    TA0CCTL0 &= ~CCIFG;
+    // 12 ticks per millisecond
+    g_keyPollTicks = (keyPollInterval << 3) + (keyPollInterval << 2);
 
-    // interrupt when CCR0 is reached.
-    // TA0CCR0 = 12 * intervalMillis
-    TA0CCR0 = (keyPollInterval << 3) + (keyPollInterval << 2);
+    // interrupt when CCR0 is reached; the ISR moves it on by one interval.
+    TA0CCR0 = readTimer() + g_keyPollTicks;
     TA0CCTL0 = CM_0 | CCIE;
-    TA0CTL = TASSEL_1 | ID_0 | MC_1;
 
-    g_timerMillisCounter = 0;
+    halEndNoInterrupts();
+}
+
+void halSetKeyWake()
+{
+    halBeginNoInterrupts();
+
+    // No more polls
+    TA0CCTL0 = 0;
+    TA0CCTL2 = 0;
+    g_keyConfirm = 0;
+
+    // Pull the buttons that are up high and interrupt when one is pulled low. One that's
+    // held down stays pulled down: through its pull-up it would draw current all along.
+    uint8_t up = ~g_lastButtons;
+    P2IE = 0;
+    P2IES = 0xFF;
+    P2OUT = up;
+
+    // Let the pins charge, then forget the edges that made. One pressed meanwhile never
+    // goes high to fall again, so flag it by hand.
+    halDelayMicroseconds(6);
+    P2IFG = 0;
+    P2IFG = ~P2IN & up;
+    P2IE = up;
+    g_keyWake = 1;
+
+    halEndNoInterrupts();
+}
+
+void halSetDeadline(HalTime time)
+{
+    halBeginNoInterrupts();
+
+    g_deadline = time;
+    TA0CCR1 = (uint16_t)time;
+    TA0CCTL1 = CM_0 | CCIE;
+
+    // Already due? (Clearing CCTL1 also drops a compare that just happened,
+    // so it fires exactly once either way.)
+    if ((int32_t)(halNow() - time) >= 0)
+    {
+        TA0CCTL1 = 0;
+        g_interruptSource |= INT_SRC_TIMER;
+    }
 
     halEndNoInterrupts();
 }
 
+void halClearDeadline()
+{
+    TA0CCTL1 = 0;
+}
+
 uint8_t halSpiTransfer(uint8_t data)
 {
     UCA0TXBUF = data;
@@ -235,6 +377,43 @@ uint8_t halSpiTransfer(uint8_t data)
     return UCA0RXBUF;
 }
 
+void halSpiWriteBurst(const uint8_t* src, int size)
+{
+    // Nothing to read back, so the only limit is keeping UCA0TXBUF full.
+    for (; size > 0; --size, ++src)
+    {
+        while (!(IFG2 & UCA0TXIFG))
+        {
+        }
+        UCA0TXBUF = *src;
+    }
+
+    // Wait for the last byte to leave the shifter, then throw away what was
+    // clocked in (this also clears UCA0RXIFG and the overrun flag).
+    while (UCA0STAT & UCBUSY)
+    {
+    }
+    (void)UCA0RXBUF;
+}
+
+// Arm CCR2 to sample the keys on the next tick, 83 us away at most. If the counter
+// ticked while we were arming it, the compare is already behind us: take the sample
+// straight away. Returns the timer as it was.
+static uint16_t armKeySample()
+{
+    uint16_t now = readTimer();
+    TA0CCR2 = now + 1;
+    TA0CCTL2 = CM_0 | CCIE;
+    if (readTimer() != now)
+    {
+        TA0CCTL2 |= CCIFG;
+    }
+    return now;
+}
+
+// Key polls come in two halves, so the pull-ups charge the pins while we sleep instead
+// of in a busy-wait: TIMER0_A0 (CCR0) turns the pull-ups on and arms CCR2 for the next
+// ACLK tick, and TIMER0_A1 (CCR2) reads the keys and turns them off again.
 #pragma vector=TIMER0_A0_VECTOR
 __interrupt void TIMER0_A0_ISR_HOOK(void)
 {
@@ -243,56 +422,70 @@ __interrupt void TIMER0_A0_ISR_HOOK(void)
     // Turn on pull-up registers
     P2OUT = 0xFF;
 
-    // Wait 2 usec for port capacitance to charge through pullups
-    // (6 us will do fine. This gives us a lot of margin, without
-    // taking TOO much extra time.)
-    halDelayMicroseconds(6);
+    uint16_t now = armKeySample();
 
-    // Now, do some more work (this gives us extra charge time for free)
-    // Handle timer (divided down from key polling interval)
-    g_timerDivCounter--;
-    if (g_timerDivCounter <= 0)
+    // Schedule the next poll. If we were held off for a whole interval, count from
+    // now rather than waiting for the counter to come round again.
+    uint16_t nextPoll = TA0CCR0 + g_keyPollTicks;
+    if ((int16_t)(nextPoll - now) <= 0)
     {
-        g_timerDivCounter = g_timerDivider;
+        nextPoll = now + g_keyPollTicks;
+    }
+    TA0CCR0 = nextPoll;
 
-        // READ VOLATILE
-        uint16_t currentMillis = g_timerMillisCounter;
+    CPU_ASLEEP;
+}
 
-        uint16_t incrementedMillis = currentMillis + g_timerTickInterval;
-        if (incrementedMillis >= currentMillis)
+#pragma vector=TIMER0_A1_VECTOR
+__interrupt void TIMER0_A1_ISR_HOOK(void)
+{
+    switch (__even_in_range(TA0IV, TA0IV_TAIFG))
+    {
+    case TA0IV_TACCR1:
+        // The low 16 bits match every 5.5 s; only fire once the whole time is due.
+        if ((int32_t)(halNow() - g_deadline) >= 0)
         {
-            // WRITE VOLATILE
-            g_timerMillisCounter = incrementedMillis;
+            TA0CCTL1 = 0;
+            g_interruptSource |= INT_SRC_TIMER;
+            LPM3_EXIT;
         }
-        else
+        break;
+
+    case TA0IV_TACCR2:
+    {
+        // Second half of the key poll: read keys
+        uint8_t buttons = ~P2IN;
+
+        // A pin that hasn't charged yet (2 us through the pullups) reads as pressed. The
+        // sample is normally a whole tick after the pull-ups went on, but can follow
+        // straight after a late poll. Rather than believe a new press, leave the pull-ups
+        // on and look again on the next tick. A release can't be a pin still charging.
+        if ((buttons & ~g_lastButtons) && !g_keyConfirm)
         {
-            // WRITE VOLATILE
-            g_timerMillisCounter = 0xFFFF;
+            g_keyConfirm = 1;
+            armKeySample();
+            break;
         }
+        g_keyConfirm = 0;
+        TA0CCTL2 = 0;
 
-        g_interruptSource |= INT_SRC_TIMER;
-        LPM3_EXIT;
-    }
-
-    // Read keys
-    uint8_t buttons = ~P2IN;
+        // Change pull-ups to pull-downs
+        P2OUT = 0x00;
 
-    // Change pull-ups to pull-downs
-    P2OUT = 0x00;
-
-    if (buttons != g_lastButtons)
-    {
-        g_lastButtons = buttons;
-        g_interruptSource |= INT_SRC_BUTTON_CHANGE;
-        LPM3_EXIT;
-        // note, this doesn't return! it keeps going to the next bit.
+        if (buttons != g_lastButtons)
+        {
+            g_lastButtons = buttons;
+            g_lastButtonsTime = halNow();
+            g_interruptSource |= INT_SRC_BUTTON_CHANGE;
+            LPM3_EXIT;
+        }
+        break;
     }
 
-    CPU_ASLEEP;
-}
-
-static void nullTimerHandler(uint16_t ignored)
-{
+    case TA0IV_TAIFG:
+        g_timeHigh++;
+        break;
+    }
 }
 
 static void nullHandler()
@@ -300,9 +493,9 @@ static void nullHandler()
 
 }
 
-void halSetTimerCallback(TimerHandler cb)
+void halSetDeadlineCallback(EventHandler cb)
 {
-    g_timerCB = cb ? cb : nullTimerHandler;
+    g_deadlineCB = cb ? cb : nullHandler;
 }
 
 void halSetRadioIRQCallback(EventHandler cb)
@@ -321,6 +514,7 @@ void halMain(EventHandler initCB)
     clockInit();
     gpioInit();
     spiInit();
+    timerInit();
     radioInit();
 
     CPU_AWAKE;
@@ -334,10 +528,9 @@ void halMain(EventHandler initCB)
         __disable_interrupt();
 
         uint8_t interruptSourceCopy = g_interruptSource;
-        uint16_t deltaMillis = g_timerMillisCounter;
         g_lastButtonsCapture = g_lastButtons;
+        g_lastButtonsTimeCapture = g_lastButtonsTime;
         g_interruptSource = 0;
-        g_timerMillisCounter = 0;
 
         if (interruptSourceCopy)
         {
@@ -350,7 +543,7 @@ void halMain(EventHandler initCB)
 
             if (interruptSourceCopy & INT_SRC_TIMER)
             {
-                (g_timerCB)(deltaMillis);
+                (g_deadlineCB)();
             }
 
             if (interruptSourceCopy & INT_SRC_RADIO_IRQ)
@@ -363,10 +556,23 @@ void halMain(EventHandler initCB)
         {
             CPU_ASLEEP;
 
-            // Enter LPM3 with interrupts enabled
-            _bis_SR_register(LPM3_bits | GIE);
+            if (g_keyWake && !(TA0CCTL1 & CCIE))
+            {
+                // Only a key can wake us, so there's nothing for ACLK to time: enter LPM4
+                // with interrupts enabled. The timer stands still until we're out.
+                _bis_SR_register(LPM4_bits | GIE);
+
+                // ...Woke up from LPM4. ISRs other than PORT2 only clear the LPM3 bits,
+                // so start ACLK again ourselves.
+                __bic_SR_register(OSCOFF);
+            }
+            else
+            {
+                // Enter LPM3 with interrupts enabled
+                _bis_SR_register(LPM3_bits | GIE);
 
-            // ...Woke up from LPM3...
+                // ...Woke up from LPM3...
+            }
 
             CPU_AWAKE;
         }
@@ -1,34 +1,82 @@
 #ifndef HAL_H
 #define HAL_H
 
-#include <msp430.h>
+// Define HAL_HOST to build against the simulated HAL in HostSim/ instead of the MSP430.
+//#define HAL_HOST
+
+#ifdef HAL_HOST
+    #include "hal_host.h"
+#else
+    #include <msp430.h>
+#endif
 #include <stdint.h>
 
 typedef void (*EventHandler)(void);
-typedef void (*TimerHandler)(uint16_t deltaMillis);
+
+// Time in ACLK ticks (VLO, ~12 kHz) since power-up. Wraps after ~4 days, so compare
+// times by their signed difference.
+typedef uint32_t HalTime;
+#define HAL_TICKS_PER_MILLI 12
+#define halMillisToTicks(millis) ((HalTime)(millis) * HAL_TICKS_PER_MILLI)
 
 void halMain(EventHandler initCB);
 
 uint8_t halReadButtons();
+// halNow() at the key poll that saw the buttons halReadButtons() returns change
+HalTime halReadButtonsTime();
 uint8_t halReadDIP();
 uint16_t halReadBatteryVoltage();
 
-#define halSpiBegin() do { P1OUT &= ~BIT3; } while(0)
-#define halSpiEnd() do { P1OUT |= BIT3; } while(0)
+#ifdef HAL_HOST
+    #define halSpiBegin() halHostSpiBegin()
+    #define halSpiEnd() halHostSpiEnd()
+#else
+    #define halSpiBegin() do { P1OUT &= ~BIT3; } while(0)
+    #define halSpiEnd() do { P1OUT |= BIT3; } while(0)
+#endif
 
 uint8_t halSpiTransfer(uint8_t mosi);
 
-void halPulseRadioCE();
+// Burst write, for use between halSpiBegin() and halSpiEnd().
+// Keeps the USCI transmit buffer loaded so the next byte is queued while the current
+// one is still shifting out, instead of waiting out every byte. Reads stay on
+// halSpiTransfer: picking each byte up behind a queued one costs as much as waiting.
+void halSpiWriteBurst(const uint8_t* src, int size);
+
+void halSetRadioCE(int high);
+
+HalTime halNow();
+
+// Milliseconds between key polls. Polls only leave LPM3 when the buttons change.
+void halSetKeyPollInterval(int keyPollIntervalMillis);
+
+// Stop polling the keys, and wake on the next press of a button that is up instead, as
+// soon as it happens. With no deadline set, halMain sleeps in LPM4 meanwhile: ACLK stops,
+// and halNow() with it. halSetKeyPollInterval() goes back to polling.
+void halSetKeyWake();
+
+// Single deadline: the deadline callback is called from halMain once halNow() reaches
+// 'time' (straight away if it already has). Setting a new deadline replaces the old one.
+// The CPU stays in LPM3 until then, however far away it is.
+void halSetDeadline(HalTime time);
+void halClearDeadline();
+void halSetDeadlineCallback(EventHandler cb);
 
-// keyPollInterval: milliseconds between key polls.
-// divider: number of key polls before a timer callback is fired.
-// E.g., for a 1ms key poll interval and divider=10, keys are polled at 1000 Hz and a timer
-// callback is called at 100 Hz.
-void halSetTimerInterval(int keyPollIntervalMillis, int divider);
-void halSetTimerCallback(TimerHandler cb);
 void halSetButtonChangeCallback(EventHandler cb);
 void halSetRadioIRQCallback(EventHandler cb);
 
+#ifdef HAL_HOST
+
+#define halDelayMicroseconds(usec) halHostDelayMicroseconds(usec)
+
+#define halBeginNoInterrupts() \
+    uint16_t halOldSR = halHostDisableInterrupts();
+
+#define halEndNoInterrupts() \
+    halHostRestoreInterrupts(halOldSR);
+
+#else
+
 #define halDelayMicroseconds(usec) _delay_cycles((usec)*8)
 
 #define halBeginNoInterrupts() \
@@ -40,9 +88,14 @@ void halSetRadioIRQCallback(EventHandler cb);
         __enable_interrupt(); \
     }
 
+#endif
+
 //#define HAL_IS_LAUNCHPAD
 
-#ifdef HAL_IS_LAUNCHPAD
+#if defined(HAL_HOST)
+    #define halLedOn() halHostSetLed(1)
+    #define halLedOff() halHostSetLed(0)
+#elif defined(HAL_IS_LAUNCHPAD)
     #define halLedOn() do { P1OUT |= BIT6; } while(0)
     #define halLedOff() do { P1OUT &= ~BIT6; } while(0)
 #else
@@ -1,5 +1,84 @@
 #include "radio.h"
 #include "hal.h"
+#include <string.h>
+
+#define RADIO_SHADOW_SIZE       (RADIO_REG_FEATURE + 1)
+#define RADIO_MAX_ADDR_SIZE     5
+
+// Last value known to be in each register. Registers with their bit clear in
+// g_radioShadowValid are unknown. The three address registers we use are kept
+// separately since they are multi-byte.
+static uint8_t g_radioShadow[RADIO_SHADOW_SIZE];
+static uint8_t g_radioShadowAddr[3][RADIO_MAX_ADDR_SIZE];
+static uint8_t g_radioShadowAddrSize[3];
+static uint32_t g_radioShadowValid = 0;
+
+static int radioIsShadowed(uint8_t reg)
+{
+    // STATUS is write-1-to-clear; the others are read-only and change on their own
+    return reg < RADIO_SHADOW_SIZE &&
+           reg != RADIO_REG_STATUS &&
+           reg != RADIO_REG_OBSERVE_TX &&
+           reg != RADIO_REG_RPD &&
+           reg != RADIO_REG_FIFO_STATUS;
+}
+
+static int radioShadowAddrIndex(uint8_t reg)
+{
+    switch (reg)
+    {
+    case RADIO_REG_RX_ADDR_P0:
+        return 0;
+    case RADIO_REG_RX_ADDR_P1:
+        return 1;
+    case RADIO_REG_TX_ADDR:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+static void radioUpdateShadow(uint8_t reg, const uint8_t* data, int size)
+{
+    if (!radioIsShadowed(reg) || size <= 0)
+    {
+        return;
+    }
+
+    int addrIndex = radioShadowAddrIndex(reg);
+    if (addrIndex >= 0)
+    {
+        if (size > RADIO_MAX_ADDR_SIZE)
+        {
+            size = RADIO_MAX_ADDR_SIZE;
+        }
+        memcpy(g_radioShadowAddr[addrIndex], data, size);
+        g_radioShadowAddrSize[addrIndex] = size;
+    }
+    else
+    {
+        g_radioShadow[reg] = *data;
+    }
+
+    g_radioShadowValid |= 1UL << reg;
+}
+
+static int radioShadowMatches(uint8_t reg, const uint8_t* data, int size)
+{
+    if (!radioIsShadowed(reg) || !(g_radioShadowValid & (1UL << reg)))
+    {
+        return 0;
+    }
+
+    int addrIndex = radioShadowAddrIndex(reg);
+    if (addrIndex >= 0)
+    {
+        return g_radioShadowAddrSize[addrIndex] == size &&
+               memcmp(g_radioShadowAddr[addrIndex], data, size) == 0;
+    }
+
+    return g_radioShadow[reg] == *data;
+}
 
 uint8_t radioReadRegisterByte(uint8_t reg)
 {
@@ -7,6 +86,11 @@ uint8_t radioReadRegisterByte(uint8_t reg)
     halSpiTransfer(reg & 0x1F);
     uint8_t value = halSpiTransfer(0xFF);
     halSpiEnd();
+
+    if (radioShadowAddrIndex(reg) < 0)
+    {
+        radioUpdateShadow(reg, &value, 1);
+    }
     return value;
 }
 
@@ -14,19 +98,78 @@ void radioWriteRegister(uint8_t reg, uint8_t* data, int size)
 {
     halSpiBegin();
     halSpiTransfer(0x20 | (reg & 0x1F));
-    for (; size > 0; --size, ++data)
-    {
-        halSpiTransfer(*data);
-    }
+    halSpiWriteBurst(data, size);
     halSpiEnd();
+
+    radioUpdateShadow(reg, data, size);
 }
 
 void radioWriteRegisterByte(uint8_t reg, uint8_t value)
 {
+    uint8_t mosi[2] = {0x20 | (reg & 0x1F), value};
     halSpiBegin();
-    halSpiTransfer(0x20 | (reg & 0x1F));
-    halSpiTransfer(value);
+    halSpiWriteBurst(mosi, sizeof(mosi));
     halSpiEnd();
+
+    radioUpdateShadow(reg, &value, 1);
+}
+
+void radioSetRegisterByte(uint8_t reg, uint8_t value)
+{
+    if (!radioShadowMatches(reg, &value, 1))
+    {
+        radioWriteRegisterByte(reg, value);
+    }
+}
+
+void radioSetRegister(uint8_t reg, uint8_t* data, int size)
+{
+    if (!radioShadowMatches(reg, data, size))
+    {
+        radioWriteRegister(reg, data, size);
+    }
+}
+
+void radioSetRegisters(const RadioRegisterInit* regs, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        radioSetRegisterByte(regs[i].reg, regs[i].value);
+    }
+}
+
+void radioInvalidateShadow()
+{
+    g_radioShadowValid = 0;
+}
+
+int radioGetShadowedRegisterByte(uint8_t reg, uint8_t* value)
+{
+    if (!radioIsShadowed(reg) || radioShadowAddrIndex(reg) >= 0 ||
+        !(g_radioShadowValid & (1UL << reg)))
+    {
+        return 0;
+    }
+
+    *value = g_radioShadow[reg];
+    return 1;
+}
+
+int radioCheckShadow(uint8_t reg)
+{
+    if (!(g_radioShadowValid & (1UL << reg)))
+    {
+        return 0;
+    }
+
+    uint8_t expected = g_radioShadow[reg];
+    if (radioReadRegisterByte(reg) != expected)
+    {
+        radioInvalidateShadow();
+        return 0;
+    }
+
+    return 1;
 }
 
 void radioReadRXPayload(uint8_t* dest, int size)
@@ -44,10 +187,7 @@ void radioWriteTXPayload(uint8_t* src, int size)
 {
     halSpiBegin();
     halSpiTransfer(0xA0);
-    for (; size > 0; --size, ++src)
-    {
-        halSpiTransfer(*src);
-    }
+    halSpiWriteBurst(src, size);
     halSpiEnd();
 }
 
@@ -85,10 +225,7 @@ void radioWriteTXPayloadNoACK(uint8_t* src, int size)
 {
     halSpiBegin();
     halSpiTransfer(0xB0);
-    for (; size > 0; --size, ++src)
-    {
-        halSpiTransfer(*src);
-    }
+    halSpiWriteBurst(src, size);
     halSpiEnd();
 }
 
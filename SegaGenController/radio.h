@@ -2,6 +2,7 @@
 #define RADIO_H
 
 #include <stdint.h>
+#include "../Common/radio_init.h"
 
 #define RADIO_REG_CONFIG      0x00
 #define RADIO_REG_EN_AA       0x01
@@ -35,6 +36,7 @@ void radioWriteRegisterByte(uint8_t reg, uint8_t value);
 void radioWriteRegister(uint8_t reg, uint8_t* data, int size);
 void radioReadRXPayload(uint8_t* dest, int size);
 void radioWriteTXPayload(uint8_t* src, int size);
+void radioWriteTXPayloadNoACK(uint8_t* src, int size);
 void radioFlushTX();
 void radioFlushRX();
 void radioReuseTXPayload();
@@ -43,4 +45,25 @@ void radioWriteTXPayload(uint8_t* src, int size);
 void radioNOP();
 uint8_t radioReadStatus();
 
+// Shadowed register writes: the chip is only written if the value differs from the
+// last value known to be in the register. Raw writes and reads keep the shadow current.
+void radioSetRegisterByte(uint8_t reg, uint8_t value);
+void radioSetRegister(uint8_t reg, uint8_t* data, int size);
+
+// radioSetRegisterByte() for each entry of a LINK_RADIO_INIT() table
+void radioSetRegisters(const RadioRegisterInit* regs, int count);
+
+// Forget everything the shadow knows (e.g. the radio was reset or browned out).
+// Anything that can power the radio down or reset it without going through this
+// driver must call this; radioCheckShadow() does when it finds out after the fact.
+void radioInvalidateShadow();
+
+// The last value known to be in a single-byte register, without an SPI read.
+// Returns nonzero if the shadow has one.
+int radioGetShadowedRegisterByte(uint8_t reg, uint8_t* value);
+
+// Read back one shadowed single-byte register and invalidate the shadow if the chip has lost it.
+// Returns nonzero if the shadow was still good.
+int radioCheckShadow(uint8_t reg);
+
 #endif // RADIO_H
@@ -4,10 +4,18 @@
 #include "awake.h"
 #include "radio.h"
 
-static void radioSleep()
+// Sleep comes in two tiers. For this long the radio stays in standby-I, configured, so
+// a press soon after we stop sends straight away; after that it's powered down, and
+// waking pays Tpd2stby first. Standby-I draws ~26 uA against ~1 uA powered down (see
+// HostSim/sleep_tier_bench.sh). 0 powers it down straight away. At most 65535.
+#ifndef SLEEP_STANDBY_MILLIS
+#define SLEEP_STANDBY_MILLIS    2000
+#endif
+
+static void radioStandby()
 {
-    // Ensure radio is powered down
-    radioWriteRegisterByte(RADIO_REG_CONFIG, 0);
+    // Nothing to send, so with CE low the radio idles in standby-I
+    halSetRadioCE(0);
 
     // Clear all queues
     radioFlushTX();
@@ -15,6 +23,18 @@ static void radioSleep()
     radioWriteRegisterByte(RADIO_REG_STATUS, BIT6 | BIT5 | BIT4);
 }
 
+static void radioSleep()
+{
+    // Ensure radio is powered down
+    radioSetRegisterByte(RADIO_REG_CONFIG, 0);
+}
+
+static int sleepMode_powerDownTask()
+{
+    radioSleep();
+    return 0;
+}
+
 static void sleepMode_onRadioIRQ()
 {
     // Just make it go away
@@ -41,12 +61,34 @@ void sleepMode_begin()
     halBeginNoInterrupts();
 
     //P1OUT &= ~BIT6;
-    radioSleep();
-    halSetTimerInterval(20, 1000/20);
+    radioStandby();
+
+    // Wait for a press (in LPM4, once nothing is left to time). A button held down (the
+    // pad left lying on it) can't wake us that way, so poll for it to be let go instead,
+    // as any change wakes us.
+    if (halReadButtons())
+    {
+        halSetKeyPollInterval(20);
+    }
+    else
+    {
+        halSetKeyWake();
+    }
+
     halSetRadioIRQCallback(&sleepMode_onRadioIRQ);
     halSetButtonChangeCallback(&sleepMode_onButtonChange);
     clearTasks();
     //addTask(&sleepMode_blah, 250);
 
+    // Standby first, then power down
+    if (SLEEP_STANDBY_MILLIS)
+    {
+        addTimer(&sleepMode_powerDownTask, SLEEP_STANDBY_MILLIS);
+    }
+    else
+    {
+        radioSleep();
+    }
+
     halEndNoInterrupts();
 }
@@ -0,0 +1,158 @@
+#include "tasks.h"
+#include "hal.h"
+
+typedef struct _Task
+{
+    HalTime deadline;
+    HalTime intervalTicks;      // 0 for one-shot tasks
+    TaskCallback callback;
+    struct _Task* next;
+} Task;
+
+#define MAX_TASKS 8
+
+static Task g_tasks[MAX_TASKS];
+
+// Pending tasks, soonest deadline first
+static Task* g_taskQueue = 0;
+static Task* g_freeTasks = 0;
+
+static void updateDeadline()
+{
+    if (g_taskQueue)
+    {
+        halSetDeadline(g_taskQueue->deadline);
+    }
+    else
+    {
+        halClearDeadline();
+    }
+}
+
+static void insertTask(Task* task)
+{
+    Task** link = &g_taskQueue;
+
+    // Behind everything due at or before it, so equal deadlines run in the order added
+    while (*link && (int32_t)((*link)->deadline - task->deadline) <= 0)
+    {
+        link = &(*link)->next;
+    }
+
+    task->next = *link;
+    *link = task;
+}
+
+static void scheduleTask(TaskCallback cb, HalTime intervalTicks, uint16_t delay)
+{
+    Task* task = g_freeTasks;
+    if (!task)
+    {
+        return;
+    }
+    g_freeTasks = task->next;
+
+    task->deadline = halNow() + halMillisToTicks(delay);
+    task->intervalTicks = intervalTicks;
+    task->callback = cb;
+    insertTask(task);
+
+    if (g_taskQueue == task)
+    {
+        updateDeadline();
+    }
+}
+
+static void runTasks()
+{
+    HalTime now = halNow();
+
+    while (g_taskQueue && (int32_t)(now - g_taskQueue->deadline) >= 0)
+    {
+        Task* task = g_taskQueue;
+        g_taskQueue = task->next;
+
+        TaskCallback callback = task->callback;
+
+        if (task->intervalTicks)
+        {
+            // Stay on the original schedule unless we've fallen a whole interval behind
+            task->deadline += task->intervalTicks;
+            if ((int32_t)(now - task->deadline) >= 0)
+            {
+                task->deadline = now + task->intervalTicks;
+            }
+            insertTask(task);
+        }
+        else
+        {
+            task->next = g_freeTasks;
+            g_freeTasks = task;
+        }
+
+        if (callback())
+        {
+            // Terminate early.
+            break;
+        }
+    }
+
+    updateDeadline();
+}
+
+void initTasks()
+{
+    clearTasks();
+    halSetDeadlineCallback(&runTasks);
+}
+
+void clearTasks()
+{
+    unsigned int i;
+
+    g_taskQueue = 0;
+    g_freeTasks = 0;
+    for (i = 0; i < MAX_TASKS; ++i)
+    {
+        g_tasks[i].next = g_freeTasks;
+        g_freeTasks = &g_tasks[i];
+    }
+
+    halClearDeadline();
+}
+
+void addTask(TaskCallback cb, uint16_t interval)
+{
+    scheduleTask(cb, halMillisToTicks(interval), interval);
+}
+
+void addTimer(TaskCallback cb, uint16_t delay)
+{
+    scheduleTask(cb, 0, delay);
+}
+
+void cancelTask(TaskCallback cb)
+{
+    Task** link = &g_taskQueue;
+    Task* first = g_taskQueue;
+
+    while (*link)
+    {
+        Task* task = *link;
+        if (task->callback == cb)
+        {
+            *link = task->next;
+            task->next = g_freeTasks;
+            g_freeTasks = task;
+        }
+        else
+        {
+            link = &task->next;
+        }
+    }
+
+    if (g_taskQueue != first)
+    {
+        updateDeadline();
+    }
+}
@@ -3,9 +3,21 @@
 
 #include <stdint.h>
 
+// Return 1 to stop running any more tasks this time round (e.g. after switching modes).
 typedef int (*TaskCallback)(void);
 
+// Tasks are kept in deadline order and the HAL deadline is set for the first one, so
+// nothing runs (and the CPU stays in LPM3) until a task is actually due.
+void initTasks();
 void clearTasks();
+
+// Periodic task, first run one interval from now.
 void addTask(TaskCallback cb, uint16_t interval);
 
+// One-shot task, run once delay milliseconds from now.
+void addTimer(TaskCallback cb, uint16_t delay);
+
+// Remove any pending runs of cb.
+void cancelTask(TaskCallback cb);
+
 #endif /* TASKS_H_ */